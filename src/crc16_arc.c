@@ -19,15 +19,21 @@
 
 #include <stdint.h>
 
-#define CRC16_ARC_POLY 0xA001
+#include "crc16_arc.h"
 
 uint16_t crc16_arc(uint16_t crc, const uint8_t *buf, int len)
 {
     while (len--)
-    {
-        crc ^= *buf++;
-        for (uint8_t i = 0; i < 8; i++)
-            crc = crc & 1 ? (crc >> 1) ^ CRC16_ARC_POLY : crc >> 1;
-    }
+        crc = crc16_arc_update(crc, *buf++);
+
+    return crc;
+}
+
+uint16_t crc16_arc_update(uint16_t crc, uint8_t data)
+{
+    crc ^= data;
+    for (uint8_t i = 0; i < 8; i++)
+        crc = crc & 1 ? (crc >> 1) ^ CRC16_ARC_POLY : crc >> 1;
+
     return crc;
 }
\ No newline at end of file
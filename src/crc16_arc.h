@@ -20,7 +20,9 @@
 #define _CRC16_ARC_H_
 
 #define CRC16_ARC_INIT 0x0000
+#define CRC16_ARC_POLY 0xA001
 
 uint16_t crc16_arc(uint16_t crc, const uint8_t *buf, int len);
+uint16_t crc16_arc_update(uint16_t crc, uint8_t data);
 
 #endif /* _CRC16_ARC_H_ */
\ No newline at end of file
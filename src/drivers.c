@@ -0,0 +1,568 @@
+/*
+ *   File:   drivers.c
+ *   Author: Matt
+ *
+ *   Created on 19 October 2026, 14:05
+ *
+ *   This is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *   This software is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *   You should have received a copy of the GNU General Public License
+ *   along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "project.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <avr/pgmspace.h>
+
+#include "onewire.h"
+#include "sensors.h"
+#include "drivers.h"
+#include "ds18b20.h"
+#include "ds28e17.h"
+#include "mcp9808.h"
+#include "veml7700.h"
+#include "timer.h"
+#include "fixedpoint.h"
+#include "util.h"
+
+#define DRIVER_NAME_WIDTH   11
+
+/*
+ * VEML7700 driver data: the auto-ranging step, whether the threshold
+ * window is set for it, whether power saving is on, and when the part
+ * next has a result, in 9 bits of 128ms ticks. A result is never further
+ * ahead than VEML7700_DRV_AHEAD_MAX, so a stamp which looks further ahead
+ * has wrapped and is long past. That holds for polls up to a minute
+ * apart; the scheduler keeps them inside DRIVER_VEML7700_POLL_MAX_MS, and
+ * the report heartbeat reads the part regardless after longer gaps.
+ */
+#define VEML7700_DRV_STEP       0x000F
+#define VEML7700_DRV_ARMED      0x0010
+#define VEML7700_DRV_PSM        0x0020
+#define VEML7700_DRV_DUE_SHIFT  7
+#define VEML7700_DRV_DUE_MASK   0x01FF
+#define VEML7700_TICK_SHIFT     7
+#define VEML7700_DRV_AHEAD_MAX  ((VEML7700_REFRESH_MAX_MS >> VEML7700_TICK_SHIFT) + 1)
+
+/*
+ * MCP9808 driver data: resolution, and whether it's woken for each
+ * reading and shut down after. Until set, the part converts continuously
+ * at the default resolution. With an alert window, whether the window
+ * is locked and whether the last reading was inside it.
+ */
+#define MCP9808_DRV_RES         0x0003
+#define MCP9808_DRV_ONESHOT     0x0004
+#define MCP9808_DRV_SET         0x0008
+#define MCP9808_DRV_WINDOW      0x0010
+#define MCP9808_DRV_LOCKED      0x0020
+#define MCP9808_DRV_IN_BAND     0x0040
+
+static bool ds18b20_drv_start(uint8_t idx, const uint8_t *id);
+static bool ds18b20_drv_poll(uint8_t idx, const uint8_t *id, uint16_t elapsed_ms);
+static bool ds18b20_drv_read(uint8_t idx, const uint8_t *id, int32_t *value);
+static bool mcp9808_drv_probe(uint8_t idx, const uint8_t *id);
+static bool mcp9808_drv_init(uint8_t idx, const uint8_t *id);
+static bool mcp9808_drv_start(uint8_t idx, const uint8_t *id);
+static bool mcp9808_drv_poll(uint8_t idx, const uint8_t *id, uint16_t elapsed_ms);
+static bool mcp9808_drv_changed(uint8_t idx, const uint8_t *id, bool *changed);
+static bool mcp9808_drv_read(uint8_t idx, const uint8_t *id, int32_t *value);
+static bool mcp9808_drv_apply(const uint8_t *id, uint16_t data);
+static uint16_t mcp9808_drv_data(uint8_t idx);
+static bool veml7700_drv_init(uint8_t idx, const uint8_t *id);
+static bool veml7700_drv_changed(uint8_t idx, const uint8_t *id, bool *changed);
+static uint16_t veml7700_drv_data(uint16_t flags, uint8_t step, bool restarted);
+static bool veml7700_drv_read(uint8_t idx, const uint8_t *id, int32_t *value);
+static uint8_t format_decicelsius(int32_t value, char *buf);
+static uint8_t format_decilux(int32_t value, char *buf);
+static uint8_t format_tenths(uint32_t tenths, char *buf);
+
+static const char _g_name_unknown[] PROGMEM = "Unknown";
+static const char _g_name_ds18b20[] PROGMEM = "DS18B20";
+static const char _g_name_veml7700[] PROGMEM = "VEML7700";
+static const char _g_name_mcp9808[] PROGMEM = "MCP9808";
+
+/* Indexed by DEV_xxx. Probed in table order, so catch-all probes go last */
+static const driver_t _g_drivers[] PROGMEM =
+{
+    [DEV_UNKNOWN] =
+    {
+        .name = _g_name_unknown,
+        .family = SENSOR_NUM_FAMILIES,
+    },
+    [DEV_DS18B20] =
+    {
+        .name = _g_name_ds18b20,
+        .family = SENSOR_FAMILY_DS18B20,
+        .start = ds18b20_drv_start,
+        .poll = ds18b20_drv_poll,
+        .read = ds18b20_drv_read,
+        .format = format_decicelsius,
+    },
+    [DEV_MPC9808] =
+    {
+        .name = _g_name_mcp9808,
+        .family = SENSOR_FAMILY_DS28E17,
+        .probe = mcp9808_drv_probe,
+        .init = mcp9808_drv_init,
+        .start = mcp9808_drv_start,
+        .poll = mcp9808_drv_poll,
+        .changed = mcp9808_drv_changed,
+        .read = mcp9808_drv_read,
+        .format = format_decicelsius,
+    },
+    [DEV_VEML7700] =
+    {
+        /* Can't easily probe VEML7700 so assume it's this if nothing else claimed the bridge */
+        .name = _g_name_veml7700,
+        .family = SENSOR_FAMILY_DS28E17,
+        .init = veml7700_drv_init,
+        .changed = veml7700_drv_changed,
+        .read = veml7700_drv_read,
+        .format = format_decilux,
+    },
+};
+
+#define NUM_DRIVERS (sizeof(_g_drivers) / sizeof(_g_drivers[0]))
+
+static const uint8_t _g_probe_order[] PROGMEM = { DEV_DS18B20, DEV_MPC9808, DEV_VEML7700 };
+
+void driver_get(uint8_t type, driver_t *drv)
+{
+    if (type >= NUM_DRIVERS)
+        type = DEV_UNKNOWN;
+
+    memcpy_P(drv, &_g_drivers[type], sizeof(driver_t));
+}
+
+/* Writes "<name> sensor", optionally padded so that columns line up. Returns the length */
+uint8_t driver_format_name(const driver_t *drv, bool pad, char *buf)
+{
+    uint8_t len = strlen_P(drv->name);
+
+    strcpy_P(buf, drv->name);
+    strcpy_P(buf + len, PSTR(" sensor"));
+
+    while (pad && len < DRIVER_NAME_WIDTH)
+        buf[sizeof(" sensor") - 1 + len++] = ' ';
+
+    len += sizeof(" sensor") - 1;
+    buf[len] = 0;
+
+    return len;
+}
+
+void driver_print_name(const driver_t *drv, bool pad)
+{
+    char name[DRIVER_NAME_MAX];
+
+    driver_format_name(drv, pad, name);
+    fputs(name, stdout);
+}
+
+/*
+ * Bridges are brought up in one pass before any probing, then each
+ * driver gets a pass over the devices nobody has claimed yet. Every
+ * bridge is therefore configured once and probed only by drivers
+ * of its family, in table order.
+ */
+void drivers_probe(void)
+{
+    uint8_t i;
+    uint8_t j;
+    uint8_t id[OW_ROMCODE_SIZE];
+    uint8_t num_sensors = sensors_count();
+    driver_t drv;
+
+    for (i = 0; i < num_sensors; i++)
+    {
+        if (sensors_family(i) == SENSOR_FAMILY_DS28E17)
+        {
+            sensors_get_id(i, id);
+            ds28e17_init(id);
+        }
+    }
+
+    for (j = 0; j < sizeof(_g_probe_order); j++)
+    {
+        uint8_t type = pgm_read_byte(&_g_probe_order[j]);
+
+        driver_get(type, &drv);
+
+        for (i = 0; i < num_sensors; i++)
+        {
+            if (sensors_type(i) != DEV_UNKNOWN)
+                continue;
+
+            if (sensors_family(i) != drv.family)
+                continue;
+
+            sensors_get_id(i, id);
+
+            if (drv.probe && !drv.probe(i, id))
+                continue;
+
+            sensors_set_type(i, type);
+
+            if (drv.init)
+                drv.init(i, id);
+        }
+    }
+}
+
+/*
+ * As drivers_probe(), for one device which has just joined the bus. A
+ * device seen before keeps its type, but is configured again since it
+ * may have lost power in between.
+ */
+void drivers_probe_device(uint8_t idx)
+{
+    uint8_t j;
+    uint8_t id[OW_ROMCODE_SIZE];
+    uint8_t type = sensors_type(idx);
+    driver_t drv;
+
+    sensors_get_id(idx, id);
+
+    if (sensors_family(idx) == SENSOR_FAMILY_DS28E17)
+        ds28e17_init(id);
+
+    for (j = 0; type == DEV_UNKNOWN && j < sizeof(_g_probe_order); j++)
+    {
+        driver_get(pgm_read_byte(&_g_probe_order[j]), &drv);
+
+        if (sensors_family(idx) != drv.family)
+            continue;
+
+        if (drv.probe && !drv.probe(idx, id))
+            continue;
+
+        type = pgm_read_byte(&_g_probe_order[j]);
+        sensors_set_type(idx, type);
+    }
+
+    driver_get(type, &drv);
+
+    if (drv.init)
+        drv.init(idx, id);
+}
+
+static bool ds18b20_drv_start(uint8_t idx, const uint8_t *id)
+{
+    return ds18b20_start_measure(id);
+}
+
+/* Elapsed from after the last Convert T. The extra ms covers timer granularity, as in convert_wait() */
+static bool ds18b20_drv_poll(uint8_t idx, const uint8_t *id, uint16_t elapsed_ms)
+{
+    return elapsed_ms >= DS18B20_TCONV_12BIT + 1;
+}
+
+static bool ds18b20_drv_read(uint8_t idx, const uint8_t *id, int32_t *value)
+{
+    int16_t temperature;
+
+    if (!ds18b20_read_decicelsius(id, &temperature))
+        return false;
+
+    *value = temperature;
+    return true;
+}
+
+/*
+ * Per-device resolution and one-shot conversion. A one-shot device is
+ * woken by the scheduler's start, read a conversion time later and shut
+ * down again; at 0.5C that's 30ms, for loops sampling at up to 30Hz.
+ */
+bool drivers_mcp9808_mode(uint8_t idx, uint8_t resolution, bool oneshot)
+{
+    uint8_t id[OW_ROMCODE_SIZE];
+    uint16_t data;
+
+    if (idx >= sensors_count() || sensors_type(idx) != DEV_MPC9808)
+        return false;
+
+    sensors_get_id(idx, id);
+    data = mcp9808_drv_data(idx) & (MCP9808_DRV_WINDOW | MCP9808_DRV_LOCKED | MCP9808_DRV_IN_BAND);
+
+    // A locked part can't shut down
+    if (oneshot && (data & MCP9808_DRV_LOCKED))
+        return false;
+
+    data |= MCP9808_DRV_SET | (oneshot ? MCP9808_DRV_ONESHOT : 0) | (resolution & MCP9808_DRV_RES);
+    sensors_set_drvdata(idx, data);
+
+    return mcp9808_drv_apply(id, data);
+}
+
+/*
+ * Alert window in decicelsius. While the temperature stays inside, a
+ * cycle reads just the flags and reports nothing new. Outside it, every
+ * cycle reads the temperature, which comes with the flags.
+ */
+bool drivers_mcp9808_window(uint8_t idx, int16_t lower, int16_t upper, int16_t crit, bool lock)
+{
+    uint8_t id[OW_ROMCODE_SIZE];
+    uint16_t data;
+
+    if (idx >= sensors_count() || sensors_type(idx) != DEV_MPC9808)
+        return false;
+
+    sensors_get_id(idx, id);
+    data = mcp9808_drv_data(idx);
+
+    if (lock && (data & MCP9808_DRV_ONESHOT))
+        return false;
+
+    if (!mcp9808_set_window(id, lower, upper, crit, lock))
+        return false;
+
+    data &= ~MCP9808_DRV_IN_BAND;
+    data |= MCP9808_DRV_SET | MCP9808_DRV_WINDOW | (lock ? MCP9808_DRV_LOCKED : 0);
+    sensors_set_drvdata(idx, data);
+
+    return true;
+}
+
+/*
+ * Power saving mode 4 cuts the part's supply current to a fraction, but
+ * a result then comes only every 4s or so, and changes are reported that
+ * much later. Off by default. Restarts the part at its current step.
+ */
+bool drivers_veml7700_power_saving(uint8_t idx, bool on)
+{
+    uint8_t id[OW_ROMCODE_SIZE];
+    uint16_t data;
+    uint8_t step;
+
+    if (idx >= sensors_count() || sensors_type(idx) != DEV_VEML7700)
+        return false;
+
+    sensors_get_id(idx, id);
+    step = sensors_drvdata(idx) & VEML7700_DRV_STEP;
+    data = veml7700_drv_data(on ? VEML7700_DRV_PSM : 0, step, true);
+    sensors_set_drvdata(idx, data);
+
+    return veml7700_init(id, step, on);
+}
+
+/*
+ * Also run when the device rejoins, so the mode survives a power cycle.
+ * Defaults are the power-on state. The window doesn't survive, so its
+ * device is read in full from then on.
+ */
+static bool mcp9808_drv_init(uint8_t idx, const uint8_t *id)
+{
+    uint16_t data = mcp9808_drv_data(idx);
+
+    if (!(data & MCP9808_DRV_SET))
+        return true;
+
+    data &= ~(MCP9808_DRV_WINDOW | MCP9808_DRV_LOCKED | MCP9808_DRV_IN_BAND);
+    sensors_set_drvdata(idx, data);
+
+    return mcp9808_drv_apply(id, data);
+}
+
+static bool mcp9808_drv_probe(uint8_t idx, const uint8_t *id)
+{
+    return mcp9808_present(id);
+}
+
+static bool mcp9808_drv_start(uint8_t idx, const uint8_t *id)
+{
+    if (!(mcp9808_drv_data(idx) & MCP9808_DRV_ONESHOT))
+        return true;
+
+    return mcp9808_shutdown(id, false);
+}
+
+static bool mcp9808_drv_poll(uint8_t idx, const uint8_t *id, uint16_t elapsed_ms)
+{
+    uint16_t data = mcp9808_drv_data(idx);
+
+    if (!(data & MCP9808_DRV_ONESHOT))
+        return true;
+
+    return elapsed_ms >= mcp9808_conv_ms(data & MCP9808_DRV_RES);
+}
+
+/* Inside the window, the one byte of flags is all that's read */
+static bool mcp9808_drv_changed(uint8_t idx, const uint8_t *id, bool *changed)
+{
+    uint16_t data = mcp9808_drv_data(idx);
+    uint8_t alerts;
+
+    *changed = true;
+
+    if (!(data & MCP9808_DRV_IN_BAND))
+        return true;
+
+    if (!mcp9808_read_alerts(id, &alerts))
+        return false;
+
+    *changed = alerts != 0;
+
+    // Nothing more to do this cycle
+    if (!*changed && (data & MCP9808_DRV_ONESHOT))
+        return mcp9808_shutdown(id, true);
+
+    return true;
+}
+
+static bool mcp9808_drv_read(uint8_t idx, const uint8_t *id, int32_t *value)
+{
+    uint16_t data = mcp9808_drv_data(idx);
+    int16_t temperature;
+    uint8_t alerts;
+
+    if (!mcp9808_read_decicelsius(id, &temperature, &alerts))
+        return false;
+
+    if ((data & MCP9808_DRV_ONESHOT) && !mcp9808_shutdown(id, true))
+        return false;
+
+    if (data & MCP9808_DRV_WINDOW)
+        sensors_set_drvdata(idx, alerts ? data & ~MCP9808_DRV_IN_BAND : data | MCP9808_DRV_IN_BAND);
+
+    *value = temperature;
+    return true;
+}
+
+static bool mcp9808_drv_apply(const uint8_t *id, uint16_t data)
+{
+    if (!mcp9808_set_resolution(id, data & MCP9808_DRV_RES))
+        return false;
+
+    return mcp9808_shutdown(id, data & MCP9808_DRV_ONESHOT);
+}
+
+static uint16_t mcp9808_drv_data(uint8_t idx)
+{
+    uint16_t data = sensors_drvdata(idx);
+
+    if (!(data & MCP9808_DRV_SET))
+        data = MCP9808_RES_DEFAULT;
+
+    return data;
+}
+
+/*
+ * The auto-ranging step and threshold state live in the sensor table.
+ * Power saving is kept when the device rejoins.
+ */
+static bool veml7700_drv_init(uint8_t idx, const uint8_t *id)
+{
+    uint16_t psm = sensors_drvdata(idx) & VEML7700_DRV_PSM;
+
+    sensors_set_drvdata(idx, veml7700_drv_data(psm, VEML7700_STEP_DEFAULT, true));
+
+    return veml7700_init(id, VEML7700_STEP_DEFAULT, psm);
+}
+
+/*
+ * Nothing to do until the part has a new result, and then only the
+ * interrupt status is read unless the light left the window. Without a
+ * window for the current step, the value is read to set one.
+ */
+static bool veml7700_drv_changed(uint8_t idx, const uint8_t *id, bool *changed)
+{
+    uint16_t data = sensors_drvdata(idx);
+    uint16_t ahead = ((data >> VEML7700_DRV_DUE_SHIFT) - (uint16_t)(timer_millis() >> VEML7700_TICK_SHIFT)) & VEML7700_DRV_DUE_MASK;
+
+    *changed = false;
+
+    if (ahead && ahead <= VEML7700_DRV_AHEAD_MAX)
+        return true;
+
+    if (!(data & VEML7700_DRV_ARMED))
+    {
+        *changed = true;
+        return true;
+    }
+
+    if (!veml7700_crossed(id, changed))
+        return false;
+
+    if (!*changed)
+        sensors_set_drvdata(idx, veml7700_drv_data((data & VEML7700_DRV_PSM) | VEML7700_DRV_ARMED, data & VEML7700_DRV_STEP, false));
+
+    return true;
+}
+
+static bool veml7700_drv_read(uint8_t idx, const uint8_t *id, int32_t *value)
+{
+    uint16_t data = sensors_drvdata(idx);
+    uint8_t step = data & VEML7700_DRV_STEP;
+    uint32_t lux;
+    bool restarted;
+
+    if (!veml7700_read_decilux(id, &step, &lux))
+    {
+        // The window may be half written, so read in full next time
+        sensors_set_drvdata(idx, data & ~VEML7700_DRV_ARMED);
+        return false;
+    }
+
+    // A change of step restarts the part, with no window
+    restarted = step != (data & VEML7700_DRV_STEP);
+    sensors_set_drvdata(idx, veml7700_drv_data((data & VEML7700_DRV_PSM) | (restarted ? 0 : VEML7700_DRV_ARMED), step, restarted));
+
+    *value = (int32_t)lux;
+    return true;
+}
+
+/* Flags are VEML7700_DRV_ARMED and _PSM. Stamped with when the part next has a result */
+static uint16_t veml7700_drv_data(uint16_t flags, uint8_t step, bool restarted)
+{
+    uint16_t ticks = (veml7700_refresh_ms(step, restarted, flags & VEML7700_DRV_PSM) >> VEML7700_TICK_SHIFT) + 1;
+    uint16_t due = ((uint16_t)(timer_millis() >> VEML7700_TICK_SHIFT) + ticks) & VEML7700_DRV_DUE_MASK;
+
+    return (due << VEML7700_DRV_DUE_SHIFT) | flags | step;
+}
+
+// single fixed point i.e. 10 = 1.0 degrees
+static uint8_t format_decicelsius(int32_t value, char *buf)
+{
+    int16_t temperature = (int16_t)value;
+    uint8_t len = sizeof("Degrees C: ") - 1;
+
+    strcpy_P(buf, PSTR("Degrees C: "));
+
+    if (temperature < 0)
+        buf[len++] = '-';
+
+    return len + format_tenths((uint16_t)abs(temperature), buf + len);
+}
+
+// single fixed point. i.e. 10 = 1.0 lux
+static uint8_t format_decilux(int32_t value, char *buf)
+{
+    uint8_t len = sizeof("      Lux: ") - 1;
+
+    strcpy_P(buf, PSTR("      Lux: "));
+
+    return len + format_tenths((uint32_t)value, buf + len);
+}
+
+static uint8_t format_tenths(uint32_t tenths, char *buf)
+{
+    uint8_t len;
+    uint8_t rem;
+
+    len = fixedpoint_format_u32(fixedpoint_div10_u32(tenths, &rem), buf);
+    buf[len++] = '.';
+    buf[len++] = '0' + rem;
+    buf[len] = 0;
+
+    return len;
+}
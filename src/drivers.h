@@ -0,0 +1,66 @@
+/*
+ *   File:   drivers.h
+ *   Author: Matt
+ *
+ *   Created on 19 October 2026, 14:05
+ *
+ *   This is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *   This software is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *   You should have received a copy of the GNU General Public License
+ *   along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __DRIVERS_H__
+#define __DRIVERS_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define DRIVER_FORMAT_MAX   24
+#define DRIVER_NAME_MAX     20      /* Padded, with " sensor" */
+#define DRIVER_VEML7700_POLL_MAX_MS 32768  /* Half the range of the VEML7700's due stamp */
+
+/*
+ * One entry per DEV_xxx type, held in flash. The device callbacks get
+ * its index in the sensor table along with its ROM code. Any callback
+ * may be NULL:
+ *
+ * probe  - true if the device (already matched by family) is this type. NULL matches anything.
+ * init   - one-off configuration after a successful probe.
+ * start  - begin a conversion. NULL for parts which convert continuously.
+ * poll   - true once the result of the last start is available. NULL means always ready.
+ * changed - whether there's anything new to read, for parts which watch for change themselves.
+ *          NULL means always. False only on a comms failure.
+ * read   - fetch the result, in the fixed point unit of the driver.
+ * format - write a value returned by read into buf, NUL terminated, and return its length. At
+ *          most DRIVER_FORMAT_MAX bytes.
+ */
+typedef struct
+{
+    const char *name;
+    uint8_t family;
+    bool (*probe)(uint8_t idx, const uint8_t *id);
+    bool (*init)(uint8_t idx, const uint8_t *id);
+    bool (*start)(uint8_t idx, const uint8_t *id);
+    bool (*poll)(uint8_t idx, const uint8_t *id, uint16_t elapsed_ms);
+    bool (*changed)(uint8_t idx, const uint8_t *id, bool *changed);
+    bool (*read)(uint8_t idx, const uint8_t *id, int32_t *value);
+    uint8_t (*format)(int32_t value, char *buf);
+} driver_t;
+
+void driver_get(uint8_t type, driver_t *drv);
+uint8_t driver_format_name(const driver_t *drv, bool pad, char *buf);
+void driver_print_name(const driver_t *drv, bool pad);
+void drivers_probe(void);
+bool drivers_mcp9808_mode(uint8_t idx, uint8_t resolution, bool oneshot);
+bool drivers_mcp9808_window(uint8_t idx, int16_t lower, int16_t upper, int16_t crit, bool lock);
+bool drivers_veml7700_power_saving(uint8_t idx, bool on);
+void drivers_probe_device(uint8_t idx);
+
+#endif /* __DRIVERS_H__ */
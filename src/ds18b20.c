@@ -26,6 +26,7 @@
 #include "ds2482.h"
 #include "ow_bitbang.h"
 #include "crc8.h"
+#include "fixedpoint.h"
 
 #define OW_SEARCH_FIRST             0xFF
 #define OW_PRESENCE_ERR             0xFF
@@ -36,37 +37,42 @@
 #define DS18B20_SP_SIZE             9
 #define DS18B20_READ                0xBE
 #define DS18B20_CONVERT_T           0x44
+#define DS18B20_READ_POWER          0xB4
 
-#define DS18B20_INVALID_DECICELSIUS 0x7FFF
+#define DS18B20_MAGNITUDE_LIMIT     0x1000  /* 256C in sixteenths */
 
-static bool ds18b20_read_scratchpad(uint8_t *id, uint8_t *sp, uint8_t n)
+static bool ds18b20_read_scratchpad(const uint8_t *id, uint8_t *sp, uint8_t n)
 {
-    uint8_t data = DS18B20_READ;
-
-    if (!ow_select(id))
-        return false;
-
-    if (!ow_write(&data, 1))
-        return false;
+    static const uint8_t cmd = DS18B20_READ;
+    const onewire_op_t txn[] =
+    {
+        OW_TXN_SELECT(id),
+        OW_TXN_WRITE(&cmd, 1),
+        OW_TXN_READ(sp, n),
+        OW_TXN_END(),
+    };
 
-    if (!ow_read(sp, n))
+    if (onewire_run(txn))
         return false;
 
     if (crc8(sp, DS18B20_SP_SIZE))
+    {
+        onewire_error(OW_ERR_CRC);
         return false;
+    }
 
     return true;
 }
 
-/* Convert scratchpad data to physical value in unit decicelsius */
-static int16_t ds18b20_raw_to_decicelsius(uint8_t *sp)
+/*
+ * Convert the scratchpad temperature to physical value in unit
+ * decicelsius. Positive values round to nearest, negative ones towards
+ * zero.
+ */
+int16_t ds18b20_raw_to_decicelsius(uint16_t measure)
 {
-    uint16_t measure;
     uint8_t  negative;
     int16_t  decicelsius;
-    uint16_t fract;
-
-    measure = sp[0] | (sp[1] << 8);
 
     /* Check for negative */
     if (measure & 0x8000)
@@ -80,20 +86,14 @@ static int16_t ds18b20_raw_to_decicelsius(uint8_t *sp)
         negative = 0;
     }
 
-    decicelsius = (measure >> 4);
-    decicelsius *= 10;
-
-    /* decicelsius += ((measure & 0x000F) * 640 + 512) / 1024;
-     * 625/1000 = 640/1024
-     */
-    fract = (measure & 0x000F) * 640;
-    if (!negative)
-        fract += 512;
-    fract /= 1024;
-    decicelsius += fract;
+    /* Anything past 256C is out of range, and wouldn't fit the conversion */
+    if (measure >= DS18B20_MAGNITUDE_LIMIT)
+        return DS18B20_INVALID_DECICELSIUS;
 
     if (negative)
-        decicelsius = -decicelsius;
+        decicelsius = -(int16_t)fixedpoint_q4_to_deci_trunc(measure);
+    else
+        decicelsius = (int16_t)fixedpoint_q4_to_deci_round(measure);
 
     if (/* decicelsius == 850 || */ decicelsius < -550 || decicelsius > 1250)
         return DS18B20_INVALID_DECICELSIUS;
@@ -102,7 +102,7 @@ static int16_t ds18b20_raw_to_decicelsius(uint8_t *sp)
 }
 
 // Returns fixed point output i.e. 10 = 1.0 degrees
-bool ds18b20_read_decicelsius(uint8_t *id, int16_t *decicelsius)
+bool ds18b20_read_decicelsius(const uint8_t *id, int16_t *decicelsius)
 {
     int16_t ret;
     uint8_t sp[DS18B20_SP_SIZE];
@@ -110,16 +110,19 @@ bool ds18b20_read_decicelsius(uint8_t *id, int16_t *decicelsius)
     if (!ds18b20_read_scratchpad(id, sp, DS18B20_SP_SIZE))
         return false;
 
-    ret = ds18b20_raw_to_decicelsius(sp);
+    ret = ds18b20_raw_to_decicelsius(sp[0] | (sp[1] << 8));
 
     if (ret == DS18B20_INVALID_DECICELSIUS)
+    {
+        onewire_error(OW_ERR_CRC);
         return false;
+    }
 
     *decicelsius = ret;
     return true;
 }
 
-bool ds18b20_start_measure(uint8_t *id)
+bool ds18b20_start_measure(const uint8_t *id)
 {
     uint8_t data = DS18B20_CONVERT_T;
     
@@ -128,3 +131,37 @@ bool ds18b20_start_measure(uint8_t *id)
 
     return ow_write(&data, 1);
 }
+
+/*
+ * As ds18b20_start_measure(), with the strong pull-up on from the end of
+ * the command. id NULL starts every DS18B20 on the bus. Nothing else may
+ * use the bus until the caller ends the conversion with ow_pullup_off().
+ */
+bool ds18b20_start_measure_powered(const uint8_t *id)
+{
+    uint8_t data = DS18B20_CONVERT_T;
+
+    if (!ow_select(id))
+        return false;
+
+    return ow_write_pullup(&data, 1);
+}
+
+/* Parasite powered parts pull the read slot low */
+bool ds18b20_read_power(const uint8_t *id, bool *parasite)
+{
+    uint8_t data = DS18B20_READ_POWER;
+    bool bit = true;
+
+    if (!ow_select(id))
+        return false;
+
+    if (!ow_write(&data, 1))
+        return false;
+
+    if (!ow_bit_io(&bit))
+        return false;
+
+    *parasite = !bit;
+    return true;
+}
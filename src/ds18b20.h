@@ -22,10 +22,16 @@
 #define DS18B20_FAMILY_CODE         0x28
 
 #define DS18B20_TCONV_12BIT         750
+#define DS18B20_CONV_MA_X2          3       /* Parasite supply current while converting, in 0.5mA steps */
+
+#define DS18B20_INVALID_DECICELSIUS 0x7FFF
 
 bool ds18b20_find_sensor(uint8_t *diff, uint8_t *id);
-bool ds18b20_start_measure(uint8_t *id);
-bool ds18b20_read_decicelsius(uint8_t *id, int16_t *decicelsius);
+bool ds18b20_start_measure(const uint8_t *id);
+bool ds18b20_start_measure_powered(const uint8_t *id);
+bool ds18b20_read_power(const uint8_t *id, bool *parasite);
+bool ds18b20_read_decicelsius(const uint8_t *id, int16_t *decicelsius);
+int16_t ds18b20_raw_to_decicelsius(uint16_t measure);
 bool ds18b20_search_sensors(uint8_t *count, uint8_t(*sensor_ids)[OW_ROMCODE_SIZE]);
 
 #endif /* __DS18B20_H__ */
\ No newline at end of file
@@ -22,9 +22,10 @@
 #include <stdbool.h>
 #include <stdio.h>
 
-#include "ds2482.h"
 #include "onewire.h"
+#include "ds2482.h"
 #include "i2c.h"
+#include "crc16_arc.h"
 
 #ifdef _OW_DS2482_
 
@@ -77,6 +78,7 @@ static uint8_t _g_devAddr;
 
 static bool ds2482_reset(void);
 static bool ds2482_write_byte(const uint8_t data);
+static bool ds2482_write_config(uint8_t cfg);
 
 bool ds2482_init(void)
 {
@@ -87,12 +89,17 @@ bool ds2482_init(void)
     if (!ds2482_reset())
         return false;
 
-    if (!i2c_write(_g_devAddr, DS2482_CMD_WRITE_CONFIG, (cfg) | (~cfg) << 4))
+    if (!ds2482_write_config(cfg))
         return false;
 
     return true;
 }
 
+static bool ds2482_write_config(uint8_t cfg)
+{
+    return i2c_write(_g_devAddr, DS2482_CMD_WRITE_CONFIG, (cfg) | (~cfg) << 4);
+}
+
 static bool ds2482_reset(void)
 {
     uint8_t status;
@@ -138,11 +145,17 @@ bool ds2482_select(const uint8_t *id)
     bool presense;
 
     if (!ds2482_bus_reset(&presense))
+    {
+        onewire_error(OW_ERR_TIMEOUT);
         return false;
+    }
     if (!presense)
+    {
+        onewire_error(OW_ERR_PRESENCE);
         return false;
+    }
 
-    if (id)
+    if (id && !onewire_single_drop())
     {
         if (!ds2482_write_byte(OW_MATCH_ROM)) /* To a single device */
             return false;
@@ -174,6 +187,66 @@ bool ds2482_write(const uint8_t *data, uint8_t len)
     return true;
 }
 
+/*
+ * As ow_writev(). Each byte's CRC is worked out while the DS2482 is
+ * shifting it out, so it costs no bus time.
+ */
+bool ds2482_writev(const onewire_seg_t *seg, uint8_t nseg, bool crc)
+{
+    uint16_t sum = CRC16_ARC_INIT;
+    uint8_t status;
+    const uint8_t *data;
+    uint8_t len;
+
+    while (nseg--)
+    {
+        data = seg->data;
+        len = seg->len;
+        seg++;
+
+        while (len--)
+        {
+            if (!i2c_write(_g_devAddr, DS2482_CMD_1WIRE_WRITE_BYTE, *data))
+                return false;
+
+            sum = crc16_arc_update(sum, *data++);
+
+            if (!i2c_await_flag(_g_devAddr, DS2482_REG_STATUS_1WB, &status, DS2482_WAIT_CYCLES))
+                return false;
+        }
+    }
+
+    if (!crc)
+        return true;
+
+    sum = ~sum;
+
+    if (!ds2482_write_byte((uint8_t)sum))
+        return false;
+
+    return ds2482_write_byte((uint8_t)(sum >> 8));
+}
+
+/* SPU applies from the end of the next byte, and holds until ds2482_pullup_off() */
+bool ds2482_write_pullup(const uint8_t *data, uint8_t len)
+{
+    if (!len)
+        return false;
+
+    if (!ds2482_write(data, len - 1))
+        return false;
+
+    if (!ds2482_write_config(DS2482_REG_CFG_APU | DS2482_REG_CFG_SPU))
+        return false;
+
+    return ds2482_write_byte(data[len - 1]);
+}
+
+bool ds2482_pullup_off(void)
+{
+    return ds2482_write_config(DS2482_REG_CFG_APU);
+}
+
 bool ds2482_read(uint8_t *buf, uint8_t len)
 {
     uint8_t status;
@@ -24,6 +24,9 @@ bool ds2482_bus_reset(bool *presense_detect);
 bool ds2482_select(const uint8_t *id);
 bool ds2482_read(uint8_t *buf, uint8_t len);
 bool ds2482_write(const uint8_t *data, uint8_t len);
+bool ds2482_writev(const onewire_seg_t *seg, uint8_t nseg, bool crc);
+bool ds2482_write_pullup(const uint8_t *data, uint8_t len);
+bool ds2482_pullup_off(void);
 bool ds2482_bit_io(bool *bit);
 uint8_t ds2482_rom_search(uint8_t diff, uint8_t *id);
 
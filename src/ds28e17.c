@@ -26,7 +26,7 @@
 #include "ds28e17.h"
 #include "ds2482.h"
 #include "ow_bitbang.h"
-#include "crc16_arc.h"
+#include "timer.h"
 
 /* DS28E17 device command codes. */
 #define DS28E17_WRITE_DATA_WITH_STOP        0x4B
@@ -55,9 +55,8 @@
 #define DS28E17_BASE_WAIT                   10
 #endif
 
-#define DS28E17_BUSY_CHECKS                 100
+#define DS28E17_BUSY_TIMEOUT_US             10000
 
-static bool ds28e17_i2c_busy_wait(uint8_t count);
 static bool ds28e17_check_error(const uint8_t *w1_buf);
 static int ds28e17_set_i2c_speed(const uint8_t *id, uint8_t speed);
 
@@ -68,97 +67,64 @@ bool ds28e17_init(const uint8_t *id)
 
 bool ds28e17_i2c_read(const uint8_t *id, uint8_t slave_addr, uint8_t reg, uint8_t *buffer, uint8_t count)
 {
-    uint16_t crc;
-    uint8_t w1_buf[3];
-
+    uint8_t w1_buf[5];
+    uint8_t status[2];
+    const onewire_op_t txn[] =
+    {
+        OW_TXN_SELECT(id),
+        OW_TXN_WRITE(w1_buf, 5),
+        OW_TXN_CRC(),
+        /* At least this long for all the I2C bytes to be transferred */
+        OW_TXN_DELAY((1 + count + 2) * DS28E17_BASE_WAIT),
+        OW_TXN_POLL(DS28E17_BASE_WAIT, DS28E17_BUSY_TIMEOUT_US),
+        OW_TXN_READ(status, 2),
+        OW_TXN_END(),
+    };
+
+    /* Command, address, write length, register, read length */
     w1_buf[0] = DS28E17_WRITE_READ_DATA_WITH_STOP;
     w1_buf[1] = slave_addr << 1;
     w1_buf[2] = 1;
+    w1_buf[3] = reg;
+    w1_buf[4] = count;
 
-    crc = crc16_arc(CRC16_ARC_INIT, w1_buf, 3);
-
-    if (!ow_select(id))
-        return false;
-
-    if (!ow_write(w1_buf, 3))
-        return false;
-
-    crc = crc16_arc(crc, &reg, 1);
-    
-    if (!ow_write(&reg, 1))
-        return false;
-
-    w1_buf[0] = count;
-    crc = crc16_arc(crc, w1_buf, 1);
-    w1_buf[1] = ~(crc & 0xFF);
-    w1_buf[2] = ~((crc >> 8) & 0xFF);
-
-    if (!ow_write(w1_buf, 3))
-        return false;
-
-    /* Wait until busy flag clears (or timeout). */
-    if (!ds28e17_i2c_busy_wait(1 + count + 2))
+    if (onewire_run(txn))
         return false;
 
-    /* Read status from DS28E17. */
-    if (!ow_read(w1_buf, 2))
+    /* The bridge only has data to send if the status is good */
+    if (!ds28e17_check_error(status))
         return false;
 
-    /* Check error conditions. */
-    if (!ds28e17_check_error(w1_buf))
-        return false;
-
-    /* Read received I2C data from DS28E17. */
+    /* Still selected, read the received I2C data */
     return ow_read(buffer, count);
 }
 
 bool ds28e17_i2c_write(const uint8_t *id, uint8_t slave_addr, uint8_t reg, const uint8_t *buffer, uint8_t count)
 {
-    uint16_t crc;
-    uint8_t w1_buf[2];
-
+    uint8_t w1_buf[4];
+    uint8_t status[2];
+    const onewire_op_t txn[] =
+    {
+        OW_TXN_SELECT(id),
+        OW_TXN_WRITE(w1_buf, 4),
+        OW_TXN_WRITE(buffer, count),
+        OW_TXN_CRC(),
+        OW_TXN_DELAY((count + 2) * DS28E17_BASE_WAIT),
+        OW_TXN_POLL(DS28E17_BASE_WAIT, DS28E17_BUSY_TIMEOUT_US),
+        OW_TXN_READ(status, 2),
+        OW_TXN_END(),
+    };
+
+    /* Command, address, length including the register, register */
     w1_buf[0] = DS28E17_WRITE_DATA_WITH_STOP;
     w1_buf[1] = slave_addr << 1;
+    w1_buf[2] = count + 1;
+    w1_buf[3] = reg;
 
-    crc = crc16_arc(CRC16_ARC_INIT, w1_buf, 2);
-
-    if (!ow_select(id))
-        return false;
-
-    if (!ow_write(w1_buf, 2))
-        return false;
-
-    w1_buf[0] = count + 1;
-    w1_buf[1] = reg;
-    crc = crc16_arc(crc, w1_buf, 2);
-
-    if (!ow_write(w1_buf, 2))
-        return false;
-
-    crc = crc16_arc(crc, buffer, count);
-
-    if (!ow_write(buffer, count))
-        return false;
-
-    w1_buf[0] = ~(crc & 0xFF);
-    w1_buf[1] = ~((crc >> 8) & 0xFF);
-    
-    if (!ow_write(w1_buf, 2))
-        return false;
-
-    /* Wait until busy flag clears (or timeout). */
-    if (!ds28e17_i2c_busy_wait(count + 2))
+    if (onewire_run(txn))
         return false;
 
-    /* Read status from DS28E17. */
-    if (!ow_read(w1_buf, 2))
-        return false;
-
-    /* Check error conditions. */
-    if (!ds28e17_check_error(w1_buf))
-        return false;
-
-    return true;
+    return ds28e17_check_error(status);
 }
 
 /* Set I2C speed on DS28E17. */
@@ -178,58 +144,19 @@ static int ds28e17_set_i2c_speed(const uint8_t *id, uint8_t speed)
     return 0;
 }
 
-/* Wait a while until the busy flag clears. */
-static bool ds28e17_i2c_busy_wait(uint8_t count)
-{
-    uint8_t i;
-    uint8_t checks;
-    bool bit;
-
-    /* Check the busy flag first in any case.*/
-    bit = true;
-    if (!ow_bit_io(&bit))
-        return false;
-    if (!bit)
-        return true;
-
-    /*
-     * Do a generously long sleep in the beginning,
-     * as we have to wait at least this time for all
-     * the I2C bytes at the given speed to be transferred.
-     */
-    for (i = 0; i < count; i++)
-        _delay_us(DS28E17_BASE_WAIT);
-
-    /* Now continusly check the busy flag sent by the DS28E17. */
-    checks = DS28E17_BUSY_CHECKS;
-
-    while (checks--)
-    {
-        /* Return success if the busy flag is cleared. */
-        bit = true;
-        if (!ow_bit_io(&bit))
-            return false;
-        if (!bit)
-            return true;
-
-        /* Wait one timeslot */
-        _delay_us(DS28E17_BASE_WAIT);
-    }
-
-    /* Timeout */
-    return false;
-}
-
 static bool ds28e17_check_error(const uint8_t *w1_buf)
 {
     if (w1_buf[0] & DS28E17_STATUS_CRC)
-        return false;
+        goto fail;
     if (w1_buf[0] & DS28E17_STATUS_ADDRESS)
-        return false;
+        goto fail;
     if (w1_buf[0] & DS28E17_STATUS_START)
-        return false;
+        goto fail;
     if (w1_buf[0] != 0 || w1_buf[1] != 0)
-        return false;
+        goto fail;
 
     return true;
+fail:
+    onewire_error(OW_ERR_BRIDGE);
+    return false;
 }
@@ -0,0 +1,111 @@
+/*
+ *   File:   fixedpoint.c
+ *   Author: Matt
+ *
+ *   Division-free fixed point conversions for the drivers and console.
+ *   The AVR has no divider, and a library divide costs a couple of
+ *   hundred cycles, so everything here is multiplies and shifts. The
+ *   bench checks each one against the plain division over every input.
+ *
+ *   Created on 19 October 2026, 21:05
+ *
+ *   This is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *   This software is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *   You should have received a copy of the GNU General Public License
+ *   along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "project.h"
+
+#include <stdint.h>
+
+#include "fixedpoint.h"
+
+/* 1/10 as 0xCCCD / 2^19, exact for every 16 bit value */
+#define DIV10_U16_MUL   0xCCCDUL
+#define DIV10_U16_SHIFT 19
+
+/*
+ * Sixteenths of a degree to tenths is * 10 / 16, or * 5 / 8. q4 is
+ * limited to 13 bits (+-256C), so * 5 fits in 16.
+ */
+
+/* Rounds towards minus infinity, as an arithmetic shift does */
+int16_t fixedpoint_q4_to_deci_floor(int16_t q4)
+{
+    return (int16_t)(q4 * 5) >> 3;
+}
+
+/* Unsigned, rounding to nearest with halves up */
+uint16_t fixedpoint_q4_to_deci_round(uint16_t q4)
+{
+    return (q4 * 5 + 4) >> 3;
+}
+
+/* Unsigned, rounding down */
+uint16_t fixedpoint_q4_to_deci_trunc(uint16_t q4)
+{
+    return (q4 * 5) >> 3;
+}
+
+/* For printing one decimal place */
+uint16_t fixedpoint_div10_u16(uint16_t value, uint8_t *rem)
+{
+    uint16_t quot = (uint16_t)((value * DIV10_U16_MUL) >> DIV10_U16_SHIFT);
+
+    *rem = (uint8_t)(value - ((quot << 3) + (quot << 1)));
+    return quot;
+}
+
+/*
+ * As above, without a 64 bit product. The estimate of value * 0.8 by
+ * shifts is low by at most one tenth, which the remainder corrects.
+ */
+uint32_t fixedpoint_div10_u32(uint32_t value, uint8_t *rem)
+{
+    uint32_t quot = (value >> 1) + (value >> 2);
+    uint32_t r;
+
+    quot += quot >> 4;
+    quot += quot >> 8;
+    quot += quot >> 16;
+    quot >>= 3;
+
+    r = value - ((quot << 3) + (quot << 1));
+
+    if (r > 9)
+    {
+        quot++;
+        r -= 10;
+    }
+
+    *rem = (uint8_t)r;
+    return quot;
+}
+
+/* Decimal digits into buf, NUL terminated. Returns the length */
+uint8_t fixedpoint_format_u32(uint32_t value, char *buf)
+{
+    char digits[10];
+    uint8_t len = 0;
+    uint8_t n = 0;
+    uint8_t rem;
+
+    do
+    {
+        value = fixedpoint_div10_u32(value, &rem);
+        digits[n++] = '0' + rem;
+    } while (value);
+
+    while (n)
+        buf[len++] = digits[--n];
+
+    buf[len] = 0;
+    return len;
+}
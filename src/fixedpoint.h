@@ -0,0 +1,33 @@
+/*
+ *   File:   fixedpoint.h
+ *   Author: Matt
+ *
+ *   Division-free fixed point conversions for the drivers and console
+ *
+ *   Created on 19 October 2026, 21:05
+ *
+ *   This is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *   This software is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *   You should have received a copy of the GNU General Public License
+ *   along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FIXEDPOINT_H__
+#define __FIXEDPOINT_H__
+
+#include <stdint.h>
+
+int16_t fixedpoint_q4_to_deci_floor(int16_t q4);
+uint16_t fixedpoint_q4_to_deci_round(uint16_t q4);
+uint16_t fixedpoint_q4_to_deci_trunc(uint16_t q4);
+uint16_t fixedpoint_div10_u16(uint16_t value, uint8_t *rem);
+uint32_t fixedpoint_div10_u32(uint32_t value, uint8_t *rem);
+uint8_t fixedpoint_format_u32(uint32_t value, char *buf);
+
+#endif /* __FIXEDPOINT_H__ */
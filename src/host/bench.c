@@ -0,0 +1,812 @@
+/*
+ *   File:   bench.c
+ *   Author: Matt
+ *
+ *   Bus time benchmarks, run against the simulated bus.
+ *
+ *   Each scenario builds a fresh bus of N devices, brings it to the state
+ *   the firmware would be in, then measures one operation. Results are
+ *   written as CSV:
+ *
+ *      scenario,devices,resets,slots,bus_us,cycles
+ *
+ *   cycles is the simulated time the operation held the CPU for, in
+ *   F_CPU clocks. Every ow_* call blocks, so on the target this is the
+ *   number of cycles the main loop loses to it.
+ *
+ *   With -b, results are compared against a baseline in the same format
+ *   and the exit status is non-zero if any figure grew by more than the
+ *   tolerance (-p, percent), or if a baseline row is missing.
+ *
+ *   First, the fixed point kernels are checked against the divisions
+ *   they replaced, over every input (a sample for 32 bit ones), and
+ *   both are timed. Any mismatch fails the run. The times are host
+ *   nanoseconds and aren't in the results: a host divides in hardware,
+ *   so they show little of the saving on the AVR, which has no divider.
+ *
+ *   Then a ring buffer is driven from both sides, with a simulated ISR
+ *   taking the other side at random points inside every call. Anything
+ *   lost, duplicated, reordered, or a wrong full or empty, fails the run.
+ *
+ *   Then a transaction with more writes than one ow_writev() call takes
+ *   has to get its CRC past a DS28E17.
+ *
+ *   Last, the console is held while the report queue fills. An error
+ *   which finds it full has to go out ahead of its device's next value.
+ *
+ *   Usage: owdemo-bench [-b baseline.csv] [-p percent] [-o results.csv]
+ *
+ *   Created on 19 October 2026, 19:15
+ *
+ *   This is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *   This software is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *   You should have received a copy of the GNU General Public License
+ *   along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "project.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "onewire.h"
+#include "sensors.h"
+#include "drivers.h"
+#include "scheduler.h"
+#include "report.h"
+#include "ds18b20.h"
+#include "ds28e17.h"
+#include "mcp9808.h"
+#include "fixedpoint.h"
+#include "timer.h"
+#include "owsim.h"
+#include "hal.h"
+
+static void ring_preempt(void);
+
+#define RING_PREEMPT() ring_preempt()
+#include "ring.h"
+
+#define BENCH_SEED              1
+#define BENCH_MAX_RESULTS       64
+#define BENCH_TOLERANCE         2       /* Percent */
+#define KERNEL_REPEAT           64
+#define KERNEL_U32_DENSE        0x01000000UL    /* Every value below, then a stride */
+#define KERNEL_U32_STRIDE       4099
+
+#define POP_ANY                 0xFF
+#define RING_SLOTS              8       /* Small, so it wraps and fills often */
+#define RING_ITEMS              1000000UL
+#define RING_BULK_MAX           11      /* More than the ring holds */
+
+typedef struct
+{
+    char scenario[24];
+    unsigned devices;
+    unsigned long resets;
+    unsigned long slots;
+    unsigned long bus_us;
+    unsigned long long cycles;
+} bench_result_t;
+
+typedef struct
+{
+    const char *name;
+    uint8_t needs;                      /* OWSIM_xxx kind which must be on the bus, or POP_ANY */
+    bool prepare;                       /* Enumerate and probe before measuring */
+    bool single;                        /* Point to point: one device of kind needs, alone on the bus */
+    bool (*run)(int target);
+} bench_t;
+
+static const unsigned _g_device_counts[] = { 1, 2, 4, 8, 16, 32, 64 };
+
+static bench_result_t _g_results[BENCH_MAX_RESULTS];
+static int _g_num_results;
+static FILE *_g_report;
+
+RING_DECLARE(bench_ring, uint16_t, RING_SLOTS);
+RING_DEFINE(bench_ring, uint16_t, RING_SLOTS)
+
+static bench_ring_t _g_ring;
+static bool _g_ring_isr_pops;           /* Otherwise it pushes */
+static bool _g_ring_in_isr;
+static bool _g_ring_failed;
+static uint32_t _g_ring_rand;
+static uint32_t _g_ring_pushed;         /* Published, as the producer's index */
+static uint32_t _g_ring_popped;
+static uint32_t _g_ring_full;
+static uint32_t _g_ring_empty;
+static uint32_t _g_ring_preempts;
+
+/*
+ * Bus population for N devices: a bridge of each kind near the front of
+ * the bus, then DS18B20s with every eighth device a bridge, alternating
+ * MCP9808 and VEML7700.
+ */
+static uint8_t population_kind(unsigned i)
+{
+    if (i == 1)
+        return OWSIM_MCP9808;
+    if (i == 2)
+        return OWSIM_VEML7700;
+    if (i >= 8 && (i & 7) == 0)
+        return (i & 8) ? OWSIM_MCP9808 : OWSIM_VEML7700;
+
+    return OWSIM_DS18B20;
+}
+
+static int populate(unsigned devices, uint8_t needs, bool single)
+{
+    unsigned i;
+    int target = -1;
+
+    timer_init();
+    owsim_init(BENCH_SEED);
+    onewire_bus_changed();
+
+    for (i = 0; i < devices; i++)
+    {
+        uint8_t kind = single ? needs : population_kind(i);
+        int dev = owsim_add(kind);
+
+        if (kind == OWSIM_VEML7700)
+            owsim_set_millilux(dev, 120000UL + i * 1000UL);
+        else
+            owsim_set_temp16(dev, (int16_t)(20 * 16 + i));
+
+        if (target < 0 && (needs == POP_ANY || needs == kind))
+            target = dev;
+    }
+
+    return target;
+}
+
+static bool run_enumerate(int target)
+{
+    uint8_t counts[SENSOR_NUM_FAMILIES];
+
+    (void)target;
+
+    sensors_init();
+    if (!sensors_enumerate(counts))
+        return false;
+    drivers_probe();
+
+    return true;
+}
+
+static bool run_ds18b20_start(int target)
+{
+    uint8_t id[OW_ROMCODE_SIZE];
+
+    owsim_get_rom(target, id);
+    return ds18b20_start_measure(id);
+}
+
+static bool run_ds18b20_read(int target)
+{
+    uint8_t id[OW_ROMCODE_SIZE];
+    int16_t value;
+
+    owsim_get_rom(target, id);
+    return ds18b20_read_decicelsius(id, &value);
+}
+
+static bool run_ds28e17_read(int target)
+{
+    uint8_t id[OW_ROMCODE_SIZE];
+    uint8_t buf[2];
+
+    owsim_get_rom(target, id);
+    return ds28e17_i2c_read(id, MCP9808_I2CADDR_BASE, 0x05, buf, sizeof(buf));
+}
+
+static bool run_mcp9808_probe(int target)
+{
+    uint8_t id[OW_ROMCODE_SIZE];
+
+    owsim_get_rom(target, id);
+    return mcp9808_present(id);
+}
+
+static bool run_cycle(int target)
+{
+    (void)target;
+
+    scheduler_cycle();
+    return true;
+}
+
+static const bench_t _g_benches[] =
+{
+    { "enumerate",      POP_ANY,        false,  false,  run_enumerate },
+    { "ds18b20_start",  OWSIM_DS18B20,  false,  false,  run_ds18b20_start },
+    { "ds18b20_read",   OWSIM_DS18B20,  false,  false,  run_ds18b20_read },
+    { "ds28e17_read",   OWSIM_MCP9808,  false,  false,  run_ds28e17_read },
+    { "ds28e17_p2p",    OWSIM_MCP9808,  true,   true,   run_ds28e17_read },
+    { "mcp9808_probe",  OWSIM_MCP9808,  false,  false,  run_mcp9808_probe },
+    { "cycle",          POP_ANY,        true,   false,  run_cycle },
+};
+
+static bool bench_run(const bench_t *bench, unsigned devices, bench_result_t *result)
+{
+    const owsim_stats_t *stats;
+    uint64_t start_ns;
+    int target;
+
+    if (bench->single && devices != 1)
+        return false;
+
+    target = populate(devices, bench->needs, bench->single);
+
+    if (target < 0)
+        return false;
+
+    if (bench->prepare)
+    {
+        if (!run_enumerate(target))
+            return false;
+        scheduler_init();
+    }
+
+    owsim_clear_stats();
+    start_ns = host_now_ns();
+
+    if (!bench->run(target))
+    {
+        fprintf(stderr, "%s failed with %u devices\n", bench->name, devices);
+        exit(2);
+    }
+
+    stats = owsim_get_stats();
+
+    snprintf(result->scenario, sizeof(result->scenario), "%s", bench->name);
+    result->devices = devices;
+    result->resets = stats->resets;
+    result->slots = stats->slots;
+    result->bus_us = (unsigned long)(stats->bus_ns / 1000);
+    result->cycles = (host_now_ns() - start_ns) * (F_CPU / 1000000UL) / 1000;
+
+    return true;
+}
+
+static void result_print(FILE *out, const bench_result_t *r)
+{
+    fprintf(out, "%s,%u,%lu,%lu,%lu,%llu\n", r->scenario, r->devices, r->resets, r->slots, r->bus_us, r->cycles);
+}
+
+static const bench_result_t *result_find(const char *scenario, unsigned devices)
+{
+    int i;
+
+    for (i = 0; i < _g_num_results; i++)
+    {
+        if (!strcmp(_g_results[i].scenario, scenario) && _g_results[i].devices == devices)
+            return &_g_results[i];
+    }
+
+    return NULL;
+}
+
+static bool over(const char *scenario, unsigned devices, const char *what,
+    unsigned long long now, unsigned long long base, unsigned tolerance)
+{
+    if (now * 100 <= base * (100 + tolerance))
+    {
+        if (now < base)
+            fprintf(_g_report, "improved:   %s/%u %s %llu -> %llu\n", scenario, devices, what, base, now);
+        return false;
+    }
+
+    fprintf(_g_report, "REGRESSION: %s/%u %s %llu -> %llu (limit +%u%%)\n", scenario, devices, what, base, now, tolerance);
+    return true;
+}
+
+/*
+ * The conversions as they were, with divisions
+ */
+
+static int16_t ref_ds18b20_decicelsius(uint16_t measure)
+{
+    uint8_t negative = 0;
+    int16_t decicelsius;
+    uint16_t fract;
+
+    if (measure & 0x8000)
+    {
+        negative = 1;
+        measure ^= 0xffff;
+        measure++;
+    }
+
+    decicelsius = (measure >> 4);
+    decicelsius *= 10;
+    fract = (measure & 0x000F) * 640;
+    if (!negative)
+        fract += 512;
+    fract /= 1024;
+    decicelsius += fract;
+
+    if (negative)
+        decicelsius = -decicelsius;
+
+    if (decicelsius < -550 || decicelsius > 1250)
+        return DS18B20_INVALID_DECICELSIUS;
+
+    return decicelsius;
+}
+
+static int16_t ref_mcp9808_decicelsius(uint16_t ambient)
+{
+    int32_t decicelsius = (ambient & 0x0FFF) * 10;
+
+    decicelsius /= 16;
+
+    if (ambient & 0x1000)
+        decicelsius -= 2560;
+
+    return (int16_t)decicelsius;
+}
+
+static uint32_t ref_div10_u32(uint32_t value, uint8_t *rem)
+{
+    *rem = value % 10;
+    return value / 10;
+}
+
+static uint32_t new_div10_u32(uint32_t value, uint8_t *rem)
+{
+    return fixedpoint_div10_u32(value, rem);
+}
+
+static uint32_t ref_div10_u16(uint32_t value, uint8_t *rem)
+{
+    *rem = (uint16_t)value % 10;
+    return (uint16_t)value / 10;
+}
+
+static uint32_t new_div10_u16(uint32_t value, uint8_t *rem)
+{
+    return fixedpoint_div10_u16((uint16_t)value, rem);
+}
+
+/* Next input to check: all of them, or for 32 bits the low ones and a stride */
+static bool kernel_next(uint32_t *value, bool wide)
+{
+    uint32_t step = (wide && *value >= KERNEL_U32_DENSE) ? KERNEL_U32_STRIDE : 1;
+
+    if (*value > (wide ? 0xFFFFFFFFUL : 0xFFFFUL) - step)
+        return false;
+
+    *value += step;
+    return true;
+}
+
+static uint64_t kernel_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static bool kernel_check_temp(const char *name, int16_t (*ref)(uint16_t), int16_t (*fn)(uint16_t))
+{
+    volatile int16_t sink;
+    uint64_t t0, t1, t2;
+    uint32_t v;
+    int r;
+
+    for (v = 0; v <= 0xFFFF; v++)
+    {
+        if (ref((uint16_t)v) != fn((uint16_t)v))
+        {
+            fprintf(_g_report, "KERNEL:     %s differs at 0x%04X: %d, was %d\n", name, v, fn((uint16_t)v), ref((uint16_t)v));
+            return false;
+        }
+    }
+
+    t0 = kernel_ns();
+    for (r = 0; r < KERNEL_REPEAT; r++)
+        for (v = 0; v <= 0xFFFF; v++)
+            sink = ref((uint16_t)v);
+    t1 = kernel_ns();
+    for (r = 0; r < KERNEL_REPEAT; r++)
+        for (v = 0; v <= 0xFFFF; v++)
+            sink = fn((uint16_t)v);
+    t2 = kernel_ns();
+    (void)sink;
+
+    fprintf(_g_report, "kernel:     %s bit-exact over 65536 inputs, %.2f -> %.2f ns per call\n", name,
+        (double)(t1 - t0) / (KERNEL_REPEAT * 65536.0), (double)(t2 - t1) / (KERNEL_REPEAT * 65536.0));
+    return true;
+}
+
+static bool kernel_check_div10(const char *name, bool wide,
+    uint32_t (*ref)(uint32_t, uint8_t *), uint32_t (*fn)(uint32_t, uint8_t *))
+{
+    volatile uint32_t sink;
+    uint64_t t0, t1, t2;
+    uint32_t count = 0;
+    uint32_t v = 0;
+    uint8_t rem_ref;
+    uint8_t rem;
+
+    do
+    {
+        if (ref(v, &rem_ref) != fn(v, &rem) || rem != rem_ref)
+        {
+            fprintf(_g_report, "KERNEL:     %s differs at %u\n", name, v);
+            return false;
+        }
+        count++;
+    } while (kernel_next(&v, wide));
+
+    t0 = kernel_ns();
+    v = 0;
+    do sink = ref(v, &rem); while (kernel_next(&v, wide));
+    t1 = kernel_ns();
+    v = 0;
+    do sink = fn(v, &rem); while (kernel_next(&v, wide));
+    t2 = kernel_ns();
+    (void)sink;
+
+    fprintf(_g_report, "kernel:     %s bit-exact over %u inputs, %.2f -> %.2f ns per call\n", name, count,
+        (double)(t1 - t0) / count, (double)(t2 - t1) / count);
+    return true;
+}
+
+static bool kernels_check(void)
+{
+    return kernel_check_temp("ds18b20_decicelsius", ref_ds18b20_decicelsius, ds18b20_raw_to_decicelsius) &&
+        kernel_check_temp("mcp9808_decicelsius", ref_mcp9808_decicelsius, mcp9808_ambient_to_decicelsius) &&
+        kernel_check_div10("div10_u16", false, ref_div10_u16, new_div10_u16) &&
+        kernel_check_div10("div10_u32", true, ref_div10_u32, new_div10_u32);
+}
+
+/*
+ * Ring buffer, main line against an interrupt
+ */
+
+static uint32_t ring_rand(uint32_t n)
+{
+    _g_ring_rand ^= _g_ring_rand << 13;
+    _g_ring_rand ^= _g_ring_rand >> 17;
+    _g_ring_rand ^= _g_ring_rand << 5;
+    return _g_ring_rand % n;
+}
+
+static void ring_fail(const char *what, uint32_t got, uint32_t want)
+{
+    if (!_g_ring_failed)
+        fprintf(_g_report, "RING:       %s consumer, %s: %u, expected %u after %u items\n",
+            _g_ring_isr_pops ? "isr" : "main", what, got, want, _g_ring_popped);
+    _g_ring_failed = true;
+}
+
+/* One push or bulk push. Each side only ever sees its own index move under it */
+static void ring_produce(void)
+{
+    uint16_t items[RING_BULK_MAX];
+    uint32_t held = _g_ring_pushed - _g_ring_popped;
+    uint8_t want = 1;
+    uint8_t n;
+    uint8_t i;
+
+    if (held > RING_SLOTS)
+        ring_fail("count", held, RING_SLOTS);
+
+    if (ring_rand(2))
+        want = 1 + ring_rand(RING_BULK_MAX);
+    if (want > RING_ITEMS - _g_ring_pushed)
+        want = (uint8_t)(RING_ITEMS - _g_ring_pushed);
+
+    for (i = 0; i < want; i++)
+        items[i] = (uint16_t)(_g_ring_pushed + i);
+
+    if (want == 1)
+        n = bench_ring_push(&_g_ring, items) ? 1 : 0;
+    else
+        n = bench_ring_push_n(&_g_ring, items, want);
+
+    /* Space is taken when the call starts, so the consumer may have freed more since */
+    if (n != (want < RING_SLOTS - held ? want : RING_SLOTS - held))
+        ring_fail("pushed", n, want < RING_SLOTS - held ? want : RING_SLOTS - held);
+
+    if (n < want)
+        _g_ring_full++;
+
+    _g_ring_pushed += n;
+}
+
+static void ring_consume(void)
+{
+    uint16_t items[RING_BULK_MAX];
+    uint32_t held = _g_ring_pushed - _g_ring_popped;
+    uint8_t want = 1;
+    uint8_t n;
+    uint8_t i;
+
+    if (ring_rand(2))
+        want = 1 + ring_rand(RING_BULK_MAX);
+
+    if (want == 1)
+        n = bench_ring_pop(&_g_ring, items) ? 1 : 0;
+    else
+        n = bench_ring_pop_n(&_g_ring, items, want);
+
+    if (n != (want < held ? want : held))
+        ring_fail("popped", n, want < held ? want : held);
+
+    if (n < want)
+        _g_ring_empty++;
+
+    for (i = 0; i < n; i++)
+    {
+        if (items[i] != (uint16_t)(_g_ring_popped + i))
+            ring_fail("item", items[i], (uint16_t)(_g_ring_popped + i));
+    }
+
+    _g_ring_popped += n;
+}
+
+static void ring_isr(void)
+{
+    _g_ring_in_isr = true;
+    _g_ring_preempts++;
+
+    if (_g_ring_isr_pops)
+        ring_consume();
+    else if (_g_ring_pushed < RING_ITEMS)
+        ring_produce();
+
+    _g_ring_in_isr = false;
+}
+
+/* Called from inside the ring functions, between loading and publishing an index */
+static void ring_preempt(void)
+{
+    if (!_g_ring_in_isr && ring_rand(3) == 0)
+        ring_isr();
+}
+
+static bool ring_check(bool isr_pops)
+{
+    _g_ring_isr_pops = isr_pops;
+    _g_ring_rand = 0x2545F491;
+    _g_ring_pushed = 0;
+    _g_ring_popped = 0;
+    _g_ring_full = 0;
+    _g_ring_empty = 0;
+    _g_ring_preempts = 0;
+    bench_ring_init(&_g_ring);
+
+    while (!_g_ring_failed && (_g_ring_popped < RING_ITEMS || _g_ring_pushed < RING_ITEMS))
+    {
+        if (isr_pops && _g_ring_pushed < RING_ITEMS)
+            ring_produce();
+        else if (!isr_pops)
+            ring_consume();
+
+        /* And between calls, as often as within them */
+        if (ring_rand(2) == 0)
+            ring_isr();
+    }
+
+    if (!_g_ring_failed && bench_ring_count(&_g_ring) != 0)
+        ring_fail("left", bench_ring_count(&_g_ring), 0);
+
+    if (_g_ring_failed)
+        return false;
+
+    fprintf(_g_report, "ring:       %s consumer, %lu items in order through %u slots, %u preemptions, %u full, %u empty\n",
+        isr_pops ? "isr" : "main", RING_ITEMS, RING_SLOTS, _g_ring_preempts, _g_ring_full, _g_ring_empty);
+    return true;
+}
+
+static bool rings_check(void)
+{
+    return ring_check(true) && ring_check(false);
+}
+
+/*
+ * A DS28E17 frame split into more writes than one ow_writev() call takes.
+ * The bridge drops the I2C write unless the CRC covers the whole frame,
+ * so the register is read back to see that it got through.
+ */
+static bool txn_check(void)
+{
+    static const uint8_t frame[] = { 0x4B, MCP9808_I2CADDR_BASE << 1, 3, 0x02, 0x01, 0x40 };
+    uint8_t id[OW_ROMCODE_SIZE];
+    uint8_t status[2];
+    uint8_t back[2];
+    const onewire_op_t txn[] =
+    {
+        OW_TXN_SELECT(id),
+        OW_TXN_WRITE(&frame[0], 1),
+        OW_TXN_WRITE(&frame[1], 1),
+        OW_TXN_WRITE(&frame[2], 1),
+        OW_TXN_WRITE(&frame[3], 1),
+        OW_TXN_WRITE(&frame[4], 1),
+        OW_TXN_WRITE(&frame[5], 1),
+        OW_TXN_CRC(),
+        OW_TXN_POLL(10, 10000),
+        OW_TXN_READ(status, 2),
+        OW_TXN_END(),
+    };
+
+    owsim_get_rom(populate(1, OWSIM_MCP9808, true), id);
+
+    if (onewire_run(txn) || status[0] || status[1] ||
+        !ds28e17_i2c_read(id, MCP9808_I2CADDR_BASE, 0x02, back, sizeof(back)) ||
+        back[0] != frame[4] || back[1] != frame[5])
+    {
+        fprintf(_g_report, "TXN:        %u writes with a CRC, status %02x %02x\n",
+            (unsigned)sizeof(frame), status[0], status[1]);
+        return false;
+    }
+
+    fprintf(_g_report, "txn:        %u writes with a CRC, %u per ow_writev()\n",
+        (unsigned)sizeof(frame), OW_OP_MAX_SEGS);
+    return true;
+}
+
+static bool report_check(void)
+{
+    report_stats_t before;
+    report_stats_t after;
+    uint8_t i;
+    bool ok;
+
+    populate(REPORT_SAMPLES + 2, OWSIM_DS18B20, true);
+    run_enumerate(0);
+    report_get_stats(&before);
+
+    // One in the line and the rest queued, then the error finds the queue full
+    host_console_hold(true);
+    for (i = 0; i <= REPORT_SAMPLES; i++)
+        report_sample(i, DEV_DS18B20, REPORT_OK, 200, timer_millis());
+    report_sample(i, DEV_DS18B20, REPORT_ERROR, 0, timer_millis());
+    report_get_stats(&after);
+    ok = after.sent - before.sent == REPORT_SAMPLES + 1 && after.dropped - before.dropped == 1;
+
+    // The error goes with the next value, and only once
+    host_console_hold(false);
+    report_sample(i, DEV_DS18B20, REPORT_OK, 200, timer_millis());
+    report_sample(i, DEV_DS18B20, REPORT_OK, 200, timer_millis());
+    report_get_stats(&after);
+    ok = ok && after.sent - before.sent == REPORT_SAMPLES + 3 && after.suppressed - before.suppressed == 1;
+
+    if (!ok)
+    {
+        fprintf(_g_report, "REPORT:     %lu sent, %lu dropped, %lu suppressed with a full queue\n",
+            after.sent - before.sent, after.dropped - before.dropped, after.suppressed - before.suppressed);
+        return false;
+    }
+
+    fprintf(_g_report, "report:     error owed from a full queue of %u sent with the next value\n", REPORT_SAMPLES);
+    return true;
+}
+
+static int compare(const char *path, unsigned tolerance)
+{
+    FILE *f = fopen(path, "r");
+    char line[128];
+    int failures = 0;
+    int rows = 0;
+
+    if (!f)
+    {
+        fprintf(stderr, "Can't open baseline %s\n", path);
+        return 2;
+    }
+
+    while (fgets(line, sizeof(line), f))
+    {
+        bench_result_t base;
+        const bench_result_t *now;
+
+        if (line[0] == '#' || sscanf(line, "%23[^,],%u,%lu,%lu,%lu,%llu",
+            base.scenario, &base.devices, &base.resets, &base.slots, &base.bus_us, &base.cycles) != 6)
+            continue;
+
+        rows++;
+        now = result_find(base.scenario, base.devices);
+
+        if (!now)
+        {
+            fprintf(_g_report, "MISSING:    %s/%u\n", base.scenario, base.devices);
+            failures++;
+            continue;
+        }
+
+        failures += over(base.scenario, base.devices, "resets", now->resets, base.resets, tolerance);
+        failures += over(base.scenario, base.devices, "slots", now->slots, base.slots, tolerance);
+        failures += over(base.scenario, base.devices, "bus_us", now->bus_us, base.bus_us, tolerance);
+        failures += over(base.scenario, base.devices, "cycles", now->cycles, base.cycles, tolerance);
+    }
+
+    fclose(f);
+
+    fprintf(_g_report, "%d baseline rows, %d regressions\n", rows, failures);
+
+    return failures ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *baseline = NULL;
+    const char *output = NULL;
+    unsigned tolerance = BENCH_TOLERANCE;
+    FILE *out;
+    size_t b;
+    size_t n;
+    int opt;
+    int i;
+
+    while ((opt = getopt(argc, argv, "b:p:o:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'b': baseline = optarg; break;
+        case 'p': tolerance = (unsigned)atoi(optarg); break;
+        case 'o': output = optarg; break;
+        default:
+            fprintf(stderr, "Usage: %s [-b baseline.csv] [-p percent] [-o results.csv]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    /* The drivers report every reading on stdout. Keep that out of the results */
+    fflush(stdout);
+    _g_report = fdopen(dup(STDOUT_FILENO), "w");
+
+    if (!_g_report || !freopen("/dev/null", "w", stdout))
+        return 2;
+
+    out = output ? fopen(output, "w") : _g_report;
+
+    if (!out)
+    {
+        fprintf(stderr, "Can't open %s\n", output);
+        return 2;
+    }
+
+    if (!kernels_check() || !rings_check() || !txn_check() || !report_check())
+        return 2;
+
+    /* A cycle here is every device on the bus, as it is in the baseline */
+    scheduler_set_bus_cap(0);
+
+    for (b = 0; b < sizeof(_g_benches) / sizeof(_g_benches[0]); b++)
+    {
+        for (n = 0; n < sizeof(_g_device_counts) / sizeof(_g_device_counts[0]); n++)
+        {
+            if (_g_num_results == BENCH_MAX_RESULTS)
+                break;
+
+            if (bench_run(&_g_benches[b], _g_device_counts[n], &_g_results[_g_num_results]))
+                _g_num_results++;
+        }
+    }
+
+    fprintf(out, "# scenario,devices,resets,slots,bus_us,cycles\n");
+    for (i = 0; i < _g_num_results; i++)
+        result_print(out, &_g_results[i]);
+
+    if (out != _g_report)
+        fclose(out);
+
+    return baseline ? compare(baseline, tolerance) : 0;
+}
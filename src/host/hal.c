@@ -0,0 +1,99 @@
+/*
+ *   File:   hal.c
+ *   Author: Matt
+ *
+ *   Host stand-ins for the AVR specific modules (timer, SFRs). Time is
+ *   simulated: it only moves when the bus simulator or a delay says so.
+ *
+ *   Created on 19 October 2026, 17:02
+ *
+ *   This is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *   This software is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *   You should have received a copy of the GNU General Public License
+ *   along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "project.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/io.h>
+#include <util/delay.h>
+
+#include "timer.h"
+#include "report.h"
+#include "usart.h"
+#include "hal.h"
+
+/* Every clock read costs a little CPU time, otherwise polling loops never see time pass */
+#define HOST_CLOCK_READ_NS  4000ULL
+
+volatile uint8_t SREG;
+
+static uint64_t _g_host_ns;
+static bool _g_console_held;
+
+void host_advance_ns(uint64_t ns)
+{
+    _g_host_ns += ns;
+}
+
+uint64_t host_now_ns(void)
+{
+    return _g_host_ns;
+}
+
+void timer_init(void)
+{
+    _g_host_ns = 0;
+}
+
+uint32_t timer_millis(void)
+{
+    _g_host_ns += HOST_CLOCK_READ_NS;
+    return (uint32_t)(_g_host_ns / 1000000ULL);
+}
+
+/* Same 4us granularity as Timer0 on the target */
+uint32_t timer_micros(void)
+{
+    _g_host_ns += HOST_CLOCK_READ_NS;
+    return (uint32_t)((_g_host_ns / 4000ULL) * 4);
+}
+
+/*
+ * Nothing else goes to the host console, so the transmit interrupt drains
+ * the report at once, unless held to stand in for a slow link.
+ */
+void usart1_kick(void)
+{
+    int16_t c;
+
+    if (_g_console_held)
+        return;
+
+    while ((c = report_tx_next(true)) >= 0)
+        putchar(c);
+}
+
+/* Released, everything queued is sent, a line per report_publish() as from the main loop */
+void host_console_hold(bool hold)
+{
+    uint8_t i;
+
+    _g_console_held = hold;
+
+    if (hold)
+        return;
+
+    usart1_kick();
+    for (i = 0; i < REPORT_SAMPLES; i++)
+        report_publish();
+}
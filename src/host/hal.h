@@ -0,0 +1,29 @@
+/*
+ *   File:   hal.h
+ *   Author: Matt
+ *
+ *   Created on 19 October 2026, 17:02
+ *
+ *   This is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *   This software is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *   You should have received a copy of the GNU General Public License
+ *   along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __HAL_H__
+#define __HAL_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+void host_advance_ns(uint64_t ns);
+uint64_t host_now_ns(void);
+void host_console_hold(bool hold);
+
+#endif /* __HAL_H__ */
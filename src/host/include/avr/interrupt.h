@@ -0,0 +1,30 @@
+/*
+ *   File:   interrupt.h
+ *   Author: Matt
+ *
+ *   Host build shim for <avr/interrupt.h>. There is only one thread of
+ *   execution on the host, so interrupt control is a no-op.
+ *
+ *   Created on 19 October 2026, 17:02
+ *
+ *   This is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *   This software is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *   You should have received a copy of the GNU General Public License
+ *   along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __HOST_AVR_INTERRUPT_H__
+#define __HOST_AVR_INTERRUPT_H__
+
+#define ISR(vector) void vector(void)
+
+#define cli() do { } while (0)
+#define sei() do { } while (0)
+
+#endif /* __HOST_AVR_INTERRUPT_H__ */
@@ -0,0 +1,35 @@
+/*
+ *   File:   io.h
+ *   Author: Matt
+ *
+ *   Host build shim for <avr/io.h>. Only what the portable modules use.
+ *
+ *   Created on 19 October 2026, 17:02
+ *
+ *   This is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *   This software is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *   You should have received a copy of the GNU General Public License
+ *   along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __HOST_AVR_IO_H__
+#define __HOST_AVR_IO_H__
+
+#include <stdint.h>
+
+#define _BV(bit)    (1 << (bit))
+
+/* Sized as an ATmega328P so that RAM budgets match the real target */
+#define RAMSTART    0x100
+#define RAMEND      0x8FF
+
+extern volatile uint8_t SREG;
+#define SREG_I      7
+
+#endif /* __HOST_AVR_IO_H__ */
@@ -0,0 +1,50 @@
+/*
+ *   File:   pgmspace.h
+ *   Author: Matt
+ *
+ *   Host build shim for <avr/pgmspace.h>. Flash and RAM share one
+ *   address space on the host, so the _P variants map straight onto
+ *   their libc counterparts.
+ *
+ *   Created on 19 October 2026, 17:02
+ *
+ *   This is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *   This software is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *   You should have received a copy of the GNU General Public License
+ *   along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __HOST_AVR_PGMSPACE_H__
+#define __HOST_AVR_PGMSPACE_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+
+#define PROGMEM
+#define PGM_P                   const char *
+#define PSTR(s)                 (s)
+
+#define pgm_read_byte(addr)     (*(const uint8_t *)(addr))
+#define pgm_read_word(addr)     (*(const uint16_t *)(addr))
+#define pgm_read_dword(addr)    (*(const uint32_t *)(addr))
+#define pgm_read_ptr(addr)      (*(void * const *)(addr))
+
+#define memcpy_P                memcpy
+#define strlen_P                strlen
+#define strcpy_P                strcpy
+#define strcmp_P                strcmp
+#define strncmp_P               strncmp
+#define strcasecmp_P            strcasecmp
+#define printf_P                printf
+#define sprintf_P               sprintf
+#define fputs_P                 fputs
+
+#endif /* __HOST_AVR_PGMSPACE_H__ */
@@ -0,0 +1,32 @@
+/*
+ *   File:   delay.h
+ *   Author: Matt
+ *
+ *   Host build shim for <util/delay.h>. Delays advance the simulated
+ *   clock instead of spinning.
+ *
+ *   Created on 19 October 2026, 17:02
+ *
+ *   This is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *   This software is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *   You should have received a copy of the GNU General Public License
+ *   along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __HOST_UTIL_DELAY_H__
+#define __HOST_UTIL_DELAY_H__
+
+#include <stdint.h>
+
+void host_advance_ns(uint64_t ns);
+
+#define _delay_us(us) host_advance_ns((uint64_t)((us) * 1000.0))
+#define _delay_ms(ms) host_advance_ns((uint64_t)((ms) * 1000000.0))
+
+#endif /* __HOST_UTIL_DELAY_H__ */
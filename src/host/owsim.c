@@ -0,0 +1,957 @@
+/*
+ *   File:   owsim.c
+ *   Author: Matt
+ *
+ *   1-wire bus simulator. Stands in for the bitbang/DS2482 backends in
+ *   the host build, modelling each slave down to the individual time
+ *   slot so that every reset and slot the drivers generate is counted.
+ *
+ *   The bus is wired-AND: on every slot each slave gets to pull the
+ *   line low, then every slave sees the resulting level. Search
+ *   collisions and Skip ROM pile-ups therefore behave as on real wire.
+ *
+ *   Created on 19 October 2026, 17:02
+ *
+ *   This is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *   This software is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *   You should have received a copy of the GNU General Public License
+ *   along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "project.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "onewire.h"
+#include "owsim.h"
+#include "hal.h"
+#include "crc8.h"
+#include "crc16_arc.h"
+
+#define ST_IDLE             0   /* Deselected, waits for reset */
+#define ST_ROM              1   /* Receiving ROM function command */
+#define ST_MATCH            2   /* Receiving ROM code after Match ROM */
+#define ST_SEARCH           3   /* Taking part in Search ROM */
+#define ST_FUNC             4   /* Receiving device function command */
+#define ST_ARGS             5   /* Receiving function arguments */
+#define ST_TX               6   /* Sending tx_buf, then all ones */
+#define ST_CONVERT          7   /* DS18B20: read slots return conversion done */
+#define ST_BUSY             8   /* DS28E17: read slots return busy, then tx_buf */
+#define ST_POWER            9   /* DS18B20: read slots return power supply mode */
+
+#define DS18B20_FAMILY      0x28
+#define DS28E17_FAMILY      0x19
+
+#define MCP9808_ADDR        0x18
+#define VEML7700_ADDR       0x10
+
+#define TX_MAX              40
+#define ARG_MAX             40
+
+typedef struct
+{
+    uint8_t rom[OW_ROMCODE_SIZE];
+    uint8_t kind;
+    bool present;
+    uint8_t state;
+
+    uint8_t rx_byte;
+    uint8_t rx_bits;
+
+    uint8_t tx_buf[TX_MAX];
+    uint8_t tx_len;
+    uint16_t tx_bit;
+
+    uint8_t search_bit;
+    uint8_t search_phase;
+    bool last_out;
+
+    uint8_t cmd;
+    uint8_t args[ARG_MAX];
+    uint8_t nargs;
+
+    /* DS18B20 */
+    uint8_t sp[9];
+    int16_t temp16;
+    bool conv_pending;
+    bool parasite;              /* No VDD, needs the strong pull-up to convert */
+    bool conv_fresh;            /* Convert T was the last thing on the bus */
+    bool starved;               /* Lost power during the conversion */
+    uint64_t conv_done_ns;
+
+    /* DS28E17 and the slave behind it */
+    uint8_t speed;
+    uint64_t busy_until_ns;
+    uint16_t regs[16];
+    uint8_t reg_ptr;
+    uint32_t millilux;
+} owsim_dev_t;
+
+static owsim_dev_t _g_devs[OWSIM_MAX_DEVICES];
+static int _g_num_devs;
+static uint32_t _g_seed;
+static uint32_t _g_reset_ns = OWSIM_RESET_NS;
+static uint32_t _g_slot_ns = OWSIM_SLOT_NS;
+static owsim_stats_t _g_stats;
+
+static uint32_t sim_rand(void)
+{
+    _g_seed = _g_seed * 1103515245UL + 12345UL;
+    return _g_seed >> 8;
+}
+
+void owsim_init(uint32_t seed)
+{
+    memset(_g_devs, 0, sizeof(_g_devs));
+    _g_num_devs = 0;
+    _g_seed = seed;
+    _g_reset_ns = OWSIM_RESET_NS;
+    _g_slot_ns = OWSIM_SLOT_NS;
+    owsim_clear_stats();
+}
+
+int owsim_add(uint8_t kind)
+{
+    owsim_dev_t *d;
+    uint8_t i;
+
+    if (_g_num_devs >= OWSIM_MAX_DEVICES)
+        return -1;
+
+    d = &_g_devs[_g_num_devs];
+    memset(d, 0, sizeof(*d));
+
+    d->kind = kind;
+    d->present = true;
+    d->state = ST_IDLE;
+    d->rom[0] = (kind == OWSIM_DS18B20) ? DS18B20_FAMILY : DS28E17_FAMILY;
+
+    for (i = 1; i < OW_ROMCODE_SIZE - 1; i++)
+        d->rom[i] = (uint8_t)sim_rand();
+
+    d->rom[OW_ROMCODE_SIZE - 1] = crc8(d->rom, OW_ROMCODE_SIZE - 1);
+
+    /* DS18B20 power-on scratchpad: 85C, TH/TL from EEPROM, 12 bit */
+    d->sp[0] = 0x50;
+    d->sp[1] = 0x05;
+    d->sp[2] = 0x4B;
+    d->sp[3] = 0x46;
+    d->sp[4] = 0x7F;
+    d->sp[5] = 0xFF;
+    d->sp[6] = 0x0C;
+    d->sp[7] = 0x10;
+    d->temp16 = 20 * 16;
+
+    /* MCP9808 power-on register values */
+    d->regs[0x06] = 0x0054;
+    d->regs[0x07] = 0x0400;
+    d->regs[0x08] = 0x0003;
+
+    /* VEML7700 powers up shut down, with nothing flagged */
+    if (kind == OWSIM_VEML7700)
+    {
+        d->regs[0x00] = 0x0001;
+        d->regs[0x06] = 0x0000;
+    }
+
+    d->millilux = 100000;
+
+    return _g_num_devs++;
+}
+
+void owsim_get_rom(int dev, uint8_t *id)
+{
+    memcpy(id, _g_devs[dev].rom, OW_ROMCODE_SIZE);
+}
+
+void owsim_set_present(int dev, bool present)
+{
+    _g_devs[dev].present = present;
+    _g_devs[dev].state = ST_IDLE;
+}
+
+void owsim_set_temp16(int dev, int16_t sixteenths)
+{
+    _g_devs[dev].temp16 = sixteenths;
+}
+
+void owsim_set_parasite(int dev, bool parasite)
+{
+    _g_devs[dev].parasite = parasite;
+}
+
+void owsim_set_millilux(int dev, uint32_t millilux)
+{
+    _g_devs[dev].millilux = millilux;
+}
+
+void owsim_set_timing(uint32_t reset_ns, uint32_t slot_ns)
+{
+    _g_reset_ns = reset_ns;
+    _g_slot_ns = slot_ns;
+}
+
+void owsim_clear_stats(void)
+{
+    memset(&_g_stats, 0, sizeof(_g_stats));
+}
+
+const owsim_stats_t *owsim_get_stats(void)
+{
+    return &_g_stats;
+}
+
+static void tx_start(owsim_dev_t *d, const uint8_t *data, uint8_t len)
+{
+    memcpy(d->tx_buf, data, len);
+    d->tx_len = len;
+    d->tx_bit = 0;
+    d->state = ST_TX;
+}
+
+/*
+ * I2C slaves behind the bridges
+ */
+
+static int16_t mcp9808_limit16(uint16_t reg)
+{
+    /* Limits are 13 bit two's complement with 0.25C resolution, bits 1:0 unused */
+    int16_t value = reg & 0x1FFC;
+
+    if (value & 0x1000)
+        value -= 0x2000;
+
+    return value;
+}
+
+static uint16_t mcp9808_ambient(owsim_dev_t *d)
+{
+    static const uint8_t res_mask[4] = { 0x07, 0x03, 0x01, 0x00 };
+    int16_t t = d->temp16 & ~res_mask[d->regs[0x08] & 0x03];
+    uint16_t reg = (uint16_t)t & 0x1FFF;
+
+    if (t >= mcp9808_limit16(d->regs[0x04]))
+        reg |= 0x8000;
+    if (t > mcp9808_limit16(d->regs[0x02]))
+        reg |= 0x4000;
+    if (t < mcp9808_limit16(d->regs[0x03]))
+        reg |= 0x2000;
+
+    return reg;
+}
+
+/* Lock bits stick until power-on and guard the limits. Shutdown isn't allowed while locked */
+static void mcp9808_write(owsim_dev_t *d, uint8_t reg, uint16_t value)
+{
+    uint16_t locks = d->regs[0x01] & 0x00C0;
+
+    if (reg == 0x01)
+    {
+        value |= locks;
+        if (value & 0x00C0)
+            value &= ~0x0100;
+    }
+    else if (reg == 0x04 ? (locks & 0x0080) : (locks & 0x0040))
+    {
+        return;
+    }
+
+    d->regs[reg] = value;
+}
+
+static uint16_t veml7700_counts(owsim_dev_t *d)
+{
+    static const uint8_t gain_factor[4] = { 2, 1, 16, 8 };
+    uint16_t conf = d->regs[0x00];
+    uint8_t it = (conf >> 6) & 0x0F;
+    uint32_t it_factor;
+    uint64_t counts;
+
+    switch (it)
+    {
+    case 0x03: it_factor = 1; break;
+    case 0x02: it_factor = 2; break;
+    case 0x01: it_factor = 4; break;
+    case 0x08: it_factor = 16; break;
+    case 0x0C: it_factor = 32; break;
+    default: it_factor = 8; break;
+    }
+
+    counts = ((uint64_t)d->millilux * 10) / (36 * gain_factor[(conf >> 11) & 0x03] * it_factor);
+
+    return counts > 0xFFFF ? 0xFFFF : (uint16_t)counts;
+}
+
+static uint8_t i2c_slave_addr(owsim_dev_t *d)
+{
+    if (d->kind == OWSIM_MCP9808)
+        return MCP9808_ADDR;
+    if (d->kind == OWSIM_VEML7700)
+        return VEML7700_ADDR;
+    return 0xFF;
+}
+
+static void i2c_slave_write(owsim_dev_t *d, const uint8_t *data, uint8_t len)
+{
+    if (!len)
+        return;
+
+    d->reg_ptr = data[0] & 0x0F;
+    data++;
+    len--;
+
+    if (d->kind == OWSIM_MCP9808)
+    {
+        if (d->reg_ptr == 0x08 && len >= 1)
+            d->regs[0x08] = data[0] & 0x03;
+        else if (len >= 2 && d->reg_ptr >= 0x01 && d->reg_ptr <= 0x04)
+            mcp9808_write(d, d->reg_ptr, (data[0] << 8) | data[1]);
+    }
+    else if (d->kind == OWSIM_VEML7700)
+    {
+        if (len >= 2 && d->reg_ptr <= 0x03)
+            d->regs[d->reg_ptr] = data[0] | (data[1] << 8);
+    }
+}
+
+static void i2c_slave_read(owsim_dev_t *d, uint8_t *data, uint8_t len)
+{
+    uint16_t value = d->regs[d->reg_ptr];
+    uint8_t i;
+
+    if (d->kind == OWSIM_MCP9808)
+    {
+        /* Shut down, the last result stays put */
+        if (d->reg_ptr == 0x05)
+            value = (d->regs[0x01] & 0x0100) ? d->regs[0x05] : mcp9808_ambient(d);
+
+        if (d->reg_ptr == 0x05)
+            d->regs[0x05] = value;
+
+        if (d->reg_ptr == 0x08)
+        {
+            for (i = 0; i < len; i++)
+                data[i] = (uint8_t)value;
+            return;
+        }
+
+        for (i = 0; i < len; i++)
+            data[i] = (i & 1) ? (uint8_t)value : (uint8_t)(value >> 8);
+    }
+    else
+    {
+        if (d->reg_ptr == 0x04)
+            value = (d->regs[0x00] & 0x0001) ? d->regs[0x04] : veml7700_counts(d);
+
+        /* Keep the last result around for when the part is shut down */
+        if (d->reg_ptr == 0x04)
+            d->regs[0x04] = value;
+
+        /* Threshold flags, as of the latest result. Not latched, which reading would clear anyway */
+        if (d->reg_ptr == 0x06 && (d->regs[0x00] & 0x0003) == 0x0002)
+        {
+            uint16_t counts = veml7700_counts(d);
+
+            value = 0;
+            if (counts > d->regs[0x01])
+                value |= 0x4000;
+            if (counts < d->regs[0x02])
+                value |= 0x8000;
+        }
+
+        for (i = 0; i < len; i++)
+            data[i] = (i & 1) ? (uint8_t)(value >> 8) : (uint8_t)value;
+    }
+}
+
+/*
+ * DS28E17
+ */
+
+static bool ds28e17_args_complete(owsim_dev_t *d)
+{
+    switch (d->cmd)
+    {
+    case 0x4B: /* Write data with stop: addr, len, data, crc */
+        return d->nargs >= 2 && d->nargs == 2 + d->args[1] + 2;
+    case 0x2D: /* Write, read data with stop: addr, wlen, data, rlen, crc */
+        return d->nargs >= 2 && d->nargs == 2 + d->args[1] + 1 + 2;
+    case 0x87: /* Read data with stop: addr, rlen, crc */
+        return d->nargs == 4;
+    case 0xD2: /* Write configuration */
+        return d->nargs == 1;
+    default:
+        return true;
+    }
+}
+
+static void ds28e17_execute(owsim_dev_t *d)
+{
+    static const uint32_t bit_ns[3] = { 10000, 2500, 1111 };
+    uint8_t frame[ARG_MAX + 1];
+    uint8_t reply[TX_MAX];
+    uint8_t reply_len = 0;
+    uint8_t status = 0;
+    uint8_t i2c_bytes = 0;
+    uint8_t wlen = 0;
+    uint8_t rlen = 0;
+    const uint8_t *wdata = NULL;
+    uint16_t crc;
+
+    if (d->cmd == 0xD2)
+    {
+        d->speed = d->args[0] & 0x03;
+        d->state = ST_IDLE;
+        return;
+    }
+
+    frame[0] = d->cmd;
+    memcpy(&frame[1], d->args, d->nargs);
+    crc = crc16_arc(CRC16_ARC_INIT, frame, d->nargs - 1);
+
+    if (d->args[d->nargs - 2] != (uint8_t)~(crc & 0xFF) || d->args[d->nargs - 1] != (uint8_t)~(crc >> 8))
+        status |= 0x01;
+
+    if (d->cmd == 0x4B || d->cmd == 0x2D)
+    {
+        wlen = d->args[1];
+        wdata = &d->args[2];
+    }
+
+    if (d->cmd == 0x2D)
+        rlen = d->args[2 + wlen];
+    if (d->cmd == 0x87)
+        rlen = d->args[1];
+
+    if (!status && (d->args[0] >> 1) != i2c_slave_addr(d))
+        status |= 0x02;
+
+    reply[reply_len++] = status;
+
+    if (d->cmd != 0x87)
+        reply[reply_len++] = 0x00; /* Write status */
+
+    if (!status)
+    {
+        i2c_bytes = 1 + wlen;
+        if (wlen)
+            i2c_slave_write(d, wdata, wlen);
+        if (rlen)
+        {
+            i2c_bytes += 1 + rlen;
+            i2c_slave_read(d, &reply[reply_len], rlen);
+            reply_len += rlen;
+        }
+    }
+
+    memcpy(d->tx_buf, reply, reply_len);
+    d->tx_len = reply_len;
+    d->tx_bit = 0;
+    d->busy_until_ns = host_now_ns() + (uint64_t)i2c_bytes * 9 * bit_ns[d->speed > 2 ? 2 : d->speed];
+    d->state = ST_BUSY;
+}
+
+static void ds28e17_function(owsim_dev_t *d)
+{
+    switch (d->cmd)
+    {
+    case 0x4B:
+    case 0x2D:
+    case 0x87:
+    case 0xD2:
+        d->nargs = 0;
+        d->state = ST_ARGS;
+        break;
+    case 0xE1:
+        tx_start(d, &d->speed, 1);
+        break;
+    default:
+        d->state = ST_IDLE;
+        break;
+    }
+}
+
+/*
+ * DS18B20
+ */
+
+static void ds18b20_latch(owsim_dev_t *d)
+{
+    if (d->conv_pending && host_now_ns() >= d->conv_done_ns)
+    {
+        /* A starved conversion leaves the power-on value, 85C */
+        d->sp[0] = d->starved ? 0x50 : (uint8_t)d->temp16;
+        d->sp[1] = d->starved ? 0x05 : (uint8_t)(d->temp16 >> 8);
+        d->conv_pending = false;
+    }
+}
+
+/* Any bus activity before a parasite conversion is done takes its power away */
+static void parasite_disturb(void)
+{
+    int i;
+
+    for (i = 0; i < _g_num_devs; i++)
+    {
+        owsim_dev_t *d = &_g_devs[i];
+
+        if (d->parasite && d->conv_pending && host_now_ns() < d->conv_done_ns)
+            d->starved = true;
+
+        d->conv_fresh = false;
+    }
+}
+
+static void ds18b20_function(owsim_dev_t *d)
+{
+    ds18b20_latch(d);
+
+    switch (d->cmd)
+    {
+    case 0x44: /* Convert T, 93.75ms << resolution bits */
+        d->conv_pending = true;
+        d->conv_fresh = true;
+        d->starved = d->parasite;
+        d->conv_done_ns = host_now_ns() + (93750000ULL << ((d->sp[4] >> 5) & 0x03));
+        d->state = ST_CONVERT;
+        break;
+    case 0xBE: /* Read scratchpad */
+        d->sp[8] = crc8(d->sp, 8);
+        tx_start(d, d->sp, 9);
+        break;
+    case 0x4E: /* Write scratchpad: TH, TL, config */
+        d->nargs = 0;
+        d->state = ST_ARGS;
+        break;
+    case 0xB4: /* Read power supply */
+        d->state = ST_POWER;
+        break;
+    case 0x48: /* Copy scratchpad, EEPROM isn't modelled */
+        d->state = ST_IDLE;
+        break;
+    default:
+        d->state = ST_IDLE;
+        break;
+    }
+}
+
+static void ds18b20_args(owsim_dev_t *d)
+{
+    if (d->nargs < 3)
+        return;
+
+    d->sp[2] = d->args[0];
+    d->sp[3] = d->args[1];
+    d->sp[4] = (d->args[2] & 0x60) | 0x1F;
+    d->state = ST_IDLE;
+}
+
+/*
+ * Slot level slave model
+ */
+
+static bool rom_bit(owsim_dev_t *d, uint8_t n)
+{
+    return (d->rom[n >> 3] >> (n & 7)) & 1;
+}
+
+static void dev_byte(owsim_dev_t *d, uint8_t b)
+{
+    switch (d->state)
+    {
+    case ST_ROM:
+        if (b == OW_SKIP_ROM)
+        {
+            d->state = ST_FUNC;
+        }
+        else if (b == OW_MATCH_ROM)
+        {
+            d->search_bit = 0;
+            d->state = ST_MATCH;
+        }
+        else if (b == OW_SEARCH_ROM)
+        {
+            d->search_bit = 0;
+            d->search_phase = 0;
+            d->state = ST_SEARCH;
+        }
+        else if (b == OW_READ_ROM)
+        {
+            tx_start(d, d->rom, OW_ROMCODE_SIZE);
+        }
+        else
+        {
+            d->state = ST_IDLE;
+        }
+        break;
+    case ST_FUNC:
+        d->cmd = b;
+        if (d->kind == OWSIM_DS18B20)
+            ds18b20_function(d);
+        else
+            ds28e17_function(d);
+        break;
+    case ST_ARGS:
+        if (d->nargs < ARG_MAX)
+            d->args[d->nargs++] = b;
+
+        if (d->kind == OWSIM_DS18B20)
+            ds18b20_args(d);
+        else if (ds28e17_args_complete(d))
+            ds28e17_execute(d);
+        break;
+    }
+}
+
+/* Level this slave leaves on the line for the current slot. 1 = released */
+static bool dev_output(owsim_dev_t *d)
+{
+    bool bit;
+
+    switch (d->state)
+    {
+    case ST_SEARCH:
+        bit = rom_bit(d, d->search_bit);
+        if (d->search_phase == 0)
+            return bit;
+        if (d->search_phase == 1)
+            return !bit;
+        return true;
+    case ST_TX:
+        if (d->tx_bit < d->tx_len * 8)
+            return (d->tx_buf[d->tx_bit >> 3] >> (d->tx_bit & 7)) & 1;
+        return true;
+    case ST_CONVERT:
+        return host_now_ns() >= d->conv_done_ns;
+    case ST_BUSY:
+        return host_now_ns() < d->busy_until_ns;
+    case ST_POWER:
+        return !d->parasite;
+    default:
+        return true;
+    }
+}
+
+/* Every slave samples the line at the end of the slot */
+static void dev_consume(owsim_dev_t *d, bool line)
+{
+    switch (d->state)
+    {
+    case ST_SEARCH:
+        if (d->search_phase < 2)
+        {
+            d->search_phase++;
+            return;
+        }
+
+        if (line != rom_bit(d, d->search_bit))
+        {
+            d->state = ST_IDLE;
+            return;
+        }
+
+        d->search_phase = 0;
+        if (++d->search_bit == OW_ROMCODE_SIZE * 8)
+            d->state = ST_FUNC;
+        return;
+    case ST_MATCH:
+        if (line != rom_bit(d, d->search_bit))
+        {
+            d->state = ST_IDLE;
+            return;
+        }
+
+        if (++d->search_bit == OW_ROMCODE_SIZE * 8)
+        {
+            d->rx_bits = 0;
+            d->state = ST_FUNC;
+        }
+        return;
+    case ST_TX:
+        d->tx_bit++;
+        return;
+    case ST_BUSY:
+        /* Master saw the busy flag clear, the results follow */
+        if (!d->last_out)
+            d->state = ST_TX;
+        return;
+    case ST_ROM:
+    case ST_FUNC:
+    case ST_ARGS:
+        d->rx_byte >>= 1;
+        if (line)
+            d->rx_byte |= 0x80;
+
+        if (++d->rx_bits == 8)
+        {
+            d->rx_bits = 0;
+            dev_byte(d, d->rx_byte);
+        }
+        return;
+    default:
+        return;
+    }
+}
+
+/* Slaves drive the line for a slot starting now. Returns the level they leave */
+bool owsim_slot_begin(void)
+{
+    bool line = true;
+    int i;
+
+    parasite_disturb();
+
+    for (i = 0; i < _g_num_devs; i++)
+    {
+        owsim_dev_t *d = &_g_devs[i];
+
+        if (!d->present)
+            continue;
+
+        d->last_out = dev_output(d);
+        line = line && d->last_out;
+    }
+
+    return line;
+}
+
+/* Slaves sample the line, including whatever the master did, at the end of the slot */
+void owsim_slot_end(bool line)
+{
+    int i;
+
+    for (i = 0; i < _g_num_devs; i++)
+    {
+        if (_g_devs[i].present)
+            dev_consume(&_g_devs[i], line);
+    }
+}
+
+/* Reset pulse seen. Returns true if anybody answers with a presence pulse */
+bool owsim_reset_pulse(void)
+{
+    bool presense = false;
+    int i;
+
+    parasite_disturb();
+
+    for (i = 0; i < _g_num_devs; i++)
+    {
+        owsim_dev_t *d = &_g_devs[i];
+
+        if (!d->present)
+            continue;
+
+        if (d->kind == OWSIM_DS18B20)
+            ds18b20_latch(d);
+
+        d->state = ST_ROM;
+        d->rx_bits = 0;
+        presense = true;
+    }
+
+    return presense;
+}
+
+static bool owsim_bit_xch(bool b)
+{
+    bool line = owsim_slot_begin() && b;
+
+    owsim_slot_end(line);
+
+    _g_stats.slots++;
+    _g_stats.bus_ns += _g_slot_ns;
+    host_advance_ns(_g_slot_ns);
+
+    return line;
+}
+
+static uint8_t owsim_byte_xch(uint8_t b)
+{
+    uint8_t i = 8;
+
+    do
+    {
+        bool j = owsim_bit_xch(b & 1);
+        b >>= 1;
+        if (j)
+            b |= 0x80;
+    } while (--i);
+
+    return b;
+}
+
+bool owsim_bus_reset(bool *presense_detect)
+{
+    *presense_detect = owsim_reset_pulse();
+
+    _g_stats.resets++;
+    _g_stats.bus_ns += _g_reset_ns;
+    host_advance_ns(_g_reset_ns);
+
+    return true;
+}
+
+bool owsim_bit_io(bool *bit)
+{
+    *bit = owsim_bit_xch(*bit);
+    return true;
+}
+
+bool owsim_read(uint8_t *buf, uint8_t len)
+{
+    while (len--)
+        *buf++ = owsim_byte_xch(0xFF);
+
+    return true;
+}
+
+bool owsim_write(const uint8_t *data, uint8_t len)
+{
+    while (len--)
+        owsim_byte_xch(*data++);
+
+    return true;
+}
+
+bool owsim_writev(const onewire_seg_t *seg, uint8_t nseg, bool crc)
+{
+    uint16_t sum = CRC16_ARC_INIT;
+    uint8_t i;
+
+    while (nseg--)
+    {
+        for (i = 0; i < seg->len; i++)
+        {
+            owsim_byte_xch(seg->data[i]);
+            sum = crc16_arc_update(sum, seg->data[i]);
+        }
+
+        seg++;
+    }
+
+    if (crc)
+    {
+        sum = ~sum;
+        owsim_byte_xch((uint8_t)sum);
+        owsim_byte_xch((uint8_t)(sum >> 8));
+    }
+
+    return true;
+}
+
+/* Conversions started by the last byte get their power */
+bool owsim_write_pullup(const uint8_t *data, uint8_t len)
+{
+    int i;
+
+    if (!len)
+        return false;
+
+    owsim_write(data, len);
+
+    for (i = 0; i < _g_num_devs; i++)
+    {
+        if (_g_devs[i].conv_fresh)
+        {
+            _g_devs[i].starved = false;
+            _g_devs[i].conv_fresh = false;
+        }
+    }
+
+    return true;
+}
+
+bool owsim_pullup_off(void)
+{
+    parasite_disturb();
+    return true;
+}
+
+/* Same algorithm as owbitbang_rom_search() */
+uint8_t owsim_rom_search(uint8_t diff, uint8_t *id)
+{
+    bool presense;
+    uint8_t i;
+    uint8_t j;
+    uint8_t next_diff;
+    bool b;
+
+    if (!owsim_bus_reset(&presense) || !presense)
+        return OW_PRESENCE_ERR;
+
+    owsim_byte_xch(OW_SEARCH_ROM);
+    next_diff = OW_LAST_DEVICE;
+
+    i = OW_ROMCODE_SIZE * 8;
+
+    do
+    {
+        j = 8;
+        do
+        {
+            b = owsim_bit_xch(1);
+            if (owsim_bit_xch(1))
+            {
+                if (b)
+                    return OW_DATA_ERR;
+            }
+            else
+            {
+                if (!b)
+                {
+                    if (diff > i || ((*id & 1) && diff != i))
+                    {
+                        b = 1;
+                        next_diff = i;
+                    }
+                }
+            }
+
+            owsim_bit_xch(b);
+            *id >>= 1;
+
+            if (b)
+                *id |= 0x80;
+
+            i--;
+
+        } while (--j);
+
+        id++;
+
+    } while (i);
+
+    return next_diff;
+}
+
+bool owsim_select(const uint8_t *id)
+{
+    bool presense;
+
+    if (!owsim_bus_reset(&presense) || !presense)
+    {
+        onewire_error(OW_ERR_PRESENCE);
+        return false;
+    }
+
+    if (id && !onewire_single_drop())
+    {
+        owsim_byte_xch(OW_MATCH_ROM);
+        owsim_write(id, OW_ROMCODE_SIZE);
+    }
+    else
+    {
+        owsim_byte_xch(OW_SKIP_ROM);
+    }
+
+    return true;
+}
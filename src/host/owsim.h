@@ -0,0 +1,73 @@
+/*
+ *   File:   owsim.h
+ *   Author: Matt
+ *
+ *   1-wire bus simulator. Stands in for the bitbang/DS2482 backends in
+ *   the host build, modelling each slave down to the individual time
+ *   slot so that every reset and slot the drivers generate is counted.
+ *
+ *   Created on 19 October 2026, 17:02
+ *
+ *   This is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *   This software is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *   You should have received a copy of the GNU General Public License
+ *   along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __OWSIM_H__
+#define __OWSIM_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define OWSIM_MAX_DEVICES       128
+
+#define OWSIM_DS18B20           0   /* Temperature sensor on the bus */
+#define OWSIM_MCP9808           1   /* DS28E17 with an MCP9808 behind it */
+#define OWSIM_VEML7700          2   /* DS28E17 with a VEML7700 behind it */
+#define OWSIM_BRIDGE            3   /* DS28E17 with nothing behind it */
+
+/* Bitbang driver defaults: 480+64+416us reset, 60us slot + 20us recovery */
+#define OWSIM_RESET_NS          960000UL
+#define OWSIM_SLOT_NS           80000UL
+
+typedef struct
+{
+    uint32_t resets;
+    uint32_t slots;
+    uint64_t bus_ns;
+} owsim_stats_t;
+
+void owsim_init(uint32_t seed);
+int owsim_add(uint8_t kind);
+void owsim_get_rom(int dev, uint8_t *id);
+void owsim_set_present(int dev, bool present);
+void owsim_set_temp16(int dev, int16_t sixteenths);
+void owsim_set_parasite(int dev, bool parasite);
+void owsim_set_millilux(int dev, uint32_t millilux);
+void owsim_set_timing(uint32_t reset_ns, uint32_t slot_ns);
+void owsim_clear_stats(void);
+const owsim_stats_t *owsim_get_stats(void);
+
+/* Edge level hooks, for harnesses which generate the master side timing themselves */
+bool owsim_reset_pulse(void);
+bool owsim_slot_begin(void);
+void owsim_slot_end(bool line);
+
+bool owsim_bus_reset(bool *presense_detect);
+bool owsim_bit_io(bool *bit);
+bool owsim_read(uint8_t *buf, uint8_t len);
+uint8_t owsim_rom_search(uint8_t diff, uint8_t *id);
+bool owsim_select(const uint8_t *id);
+bool owsim_write(const uint8_t *data, uint8_t len);
+bool owsim_writev(const onewire_seg_t *seg, uint8_t nseg, bool crc);
+bool owsim_write_pullup(const uint8_t *data, uint8_t len);
+bool owsim_pullup_off(void);
+
+#endif /* __OWSIM_H__ */
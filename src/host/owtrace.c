@@ -0,0 +1,417 @@
+/*
+ *   File:   owtrace.c
+ *   Author: Matt
+ *
+ *   Slot timing check. Runs the real owdemo.elf under simavr with the
+ *   simulated slaves from owsim.c answering on IO6, records the line to
+ *   a VCD trace and measures every reset, slot and recovery period the
+ *   bitbang driver produces against the 1-Wire standard speed windows.
+ *
+ *   The slaves only hold a zero for the minimum data valid time (-h),
+ *   so a master which samples late reads ones, enumeration finds nothing
+ *   and the check fails. Shorten it to see how much margin there is.
+ *
+ *   Usage: owtrace [-f owdemo.elf] [-o owtrace.vcd] [-t ds18b20] [-m mcp9808]
+ *                  [-l veml7700] [-r run_ms] [-h hold_us]
+ *
+ *   Needs simavr (libsimavr and its headers). Build with 'make slot-check'.
+ *
+ *   Created on 20 October 2026, 10:12
+ *
+ *   This is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *   This software is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *   You should have received a copy of the GNU General Public License
+ *   along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#include <sim_avr.h>
+#include <sim_elf.h>
+#include <sim_io.h>
+#include <sim_vcd_file.h>
+#include <sim_cycle_timers.h>
+#include <avr_ioport.h>
+#include <avr_uart.h>
+
+#include "owsim.h"
+#include "hal.h"
+
+#define TRACE_MCU               "atmega328p"
+#define TRACE_FREQUENCY         16000000UL
+#define TRACE_PORT              'D'
+#define TRACE_BIT               6           /* IO6 on the Uno */
+#define TRACE_UART              '0'
+
+#define TRACE_RESET_DETECT_US   400         /* Anything longer low is taken as a reset */
+#define TRACE_PD_HIGH_US        30          /* Slave waits this long before presence */
+#define TRACE_PD_LOW_US         120         /* and holds presence for this long */
+#define TRACE_SAMPLE_US         30          /* Slave samples master writes here */
+#define TRACE_HOLD_US           15          /* Minimum data valid time, tRDV */
+
+#define TRACE_CONSOLE_SIZE      4096
+
+#define SIG_LINE                0
+#define SIG_MASTER              1
+#define SIG_SLAVE               2
+#define SIG_COUNT               3
+
+/* Standard speed windows, DS18B20 datasheet. Zero means no limit */
+typedef struct
+{
+    const char *name;
+    const char *what;
+    double min_us;
+    double max_us;
+    double lo;
+    double hi;
+    unsigned long count;
+} window_t;
+
+enum { W_RSTL, W_RSTH, W_SLOT, W_LOW0, W_LOW1, W_REC, W_COUNT };
+
+static window_t _g_windows[W_COUNT] =
+{
+    { "tRSTL", "reset low",           480, 0 },
+    { "tRSTH", "reset high",          480, 0 },
+    { "tSLOT", "time slot",           60,  120 },
+    { "tLOW0", "write 0 low",         60,  120 },
+    { "tLOW1", "write 1 / read low",  1,   15 },
+    { "tREC",  "recovery",            1,   0 },
+};
+
+static avr_t *_g_avr;
+static avr_irq_t *_g_signals;
+
+static uint8_t _g_ddr;
+static uint8_t _g_port;
+static bool _g_master_low;
+static bool _g_slave_low;
+
+static avr_cycle_count_t _g_fall;
+static avr_cycle_count_t _g_rise;
+static bool _g_after_reset;
+static bool _g_after_slot;
+static bool _g_in_presence;
+static bool _g_slot_out;
+static uint32_t _g_hold_us = TRACE_HOLD_US;
+
+static char _g_console[TRACE_CONSOLE_SIZE];
+static size_t _g_console_len;
+
+static double cycles_to_us(avr_cycle_count_t cycles)
+{
+    return (double)cycles * 1000000.0 / TRACE_FREQUENCY;
+}
+
+static void window_record(int w, avr_cycle_count_t cycles)
+{
+    window_t *win = &_g_windows[w];
+    double us = cycles_to_us(cycles);
+
+    if (!win->count || us < win->lo)
+        win->lo = us;
+    if (!win->count || us > win->hi)
+        win->hi = us;
+
+    win->count++;
+}
+
+/* Keep the owsim clock, used for conversion and bridge busy times, on the AVR's */
+static void sync_clock(void)
+{
+    uint64_t now_ns = _g_avr->cycle * 1000000000ULL / TRACE_FREQUENCY;
+
+    if (now_ns > host_now_ns())
+        host_advance_ns(now_ns - host_now_ns());
+}
+
+static void update_line(void)
+{
+    avr_ioport_external_t ext;
+    bool line = !_g_master_low && !_g_slave_low;
+
+    /* Pull-up is external. Slaves pull the pin low when it's an input */
+    ext.name = TRACE_PORT;
+    ext.mask = 1 << TRACE_BIT;
+    ext.value = _g_slave_low ? 0 : (1 << TRACE_BIT);
+    avr_ioctl(_g_avr, AVR_IOCTL_IOPORT_SET_EXTERNAL(TRACE_PORT), &ext);
+
+    avr_raise_irq(_g_signals + SIG_LINE, line);
+    avr_raise_irq(_g_signals + SIG_MASTER, _g_master_low);
+    avr_raise_irq(_g_signals + SIG_SLAVE, _g_slave_low);
+}
+
+static avr_cycle_count_t slave_release(avr_t *avr, avr_cycle_count_t when, void *param)
+{
+    _g_slave_low = false;
+    _g_in_presence = false;
+    update_line();
+    return 0;
+}
+
+static avr_cycle_count_t presence_start(avr_t *avr, avr_cycle_count_t when, void *param)
+{
+    _g_slave_low = true;
+    update_line();
+    avr_cycle_timer_register_usec(avr, TRACE_PD_LOW_US, slave_release, NULL);
+    return 0;
+}
+
+/* Reset pulses are sampled as a zero too, the reset that follows discards it */
+static avr_cycle_count_t slot_sample(avr_t *avr, avr_cycle_count_t when, void *param)
+{
+    sync_clock();
+    owsim_slot_end(_g_slot_out && !_g_master_low);
+    return 0;
+}
+
+static void master_fall(void)
+{
+    avr_cycle_count_t now = _g_avr->cycle;
+
+    if (_g_after_reset)
+        window_record(W_RSTH, now - _g_rise);
+    if (_g_after_slot)
+    {
+        window_record(W_SLOT, now - _g_fall);
+        window_record(W_REC, now - _g_rise);
+    }
+
+    _g_fall = now;
+
+    if (_g_in_presence)
+        return;
+
+    sync_clock();
+    _g_slot_out = owsim_slot_begin();
+
+    if (!_g_slot_out)
+    {
+        _g_slave_low = true;
+        avr_cycle_timer_register_usec(_g_avr, _g_hold_us, slave_release, NULL);
+    }
+
+    avr_cycle_timer_register_usec(_g_avr, TRACE_SAMPLE_US, slot_sample, NULL);
+}
+
+static void master_rise(void)
+{
+    avr_cycle_count_t now = _g_avr->cycle;
+    double low_us = cycles_to_us(now - _g_fall);
+
+    _g_rise = now;
+    _g_after_reset = false;
+    _g_after_slot = false;
+
+    if (low_us >= TRACE_RESET_DETECT_US)
+    {
+        window_record(W_RSTL, now - _g_fall);
+        _g_after_reset = true;
+
+        sync_clock();
+        if (owsim_reset_pulse())
+        {
+            _g_in_presence = true;
+            avr_cycle_timer_register_usec(_g_avr, TRACE_PD_HIGH_US, presence_start, NULL);
+        }
+        return;
+    }
+
+    window_record(low_us < 15.0 ? W_LOW1 : W_LOW0, now - _g_fall);
+    _g_after_slot = true;
+}
+
+static void master_changed(void)
+{
+    bool low = (_g_ddr & (1 << TRACE_BIT)) && !(_g_port & (1 << TRACE_BIT));
+
+    if (low == _g_master_low)
+        return;
+
+    _g_master_low = low;
+
+    if (low)
+        master_fall();
+    else
+        master_rise();
+
+    update_line();
+}
+
+static void ddr_notify(avr_irq_t *irq, uint32_t value, void *param)
+{
+    _g_ddr = (uint8_t)value;
+    master_changed();
+}
+
+static void port_notify(avr_irq_t *irq, uint32_t value, void *param)
+{
+    _g_port = (uint8_t)value;
+    master_changed();
+}
+
+static void uart_notify(avr_irq_t *irq, uint32_t value, void *param)
+{
+    if (_g_console_len < sizeof(_g_console) - 1)
+        _g_console[_g_console_len++] = (char)value;
+}
+
+static bool check_windows(void)
+{
+    bool ok = true;
+    int i;
+
+    printf("%-6s %-20s %8s %8s %8s %8s %7s\n", "", "", "min", "max", "spec", "spec", "count");
+
+    for (i = 0; i < W_COUNT; i++)
+    {
+        window_t *w = &_g_windows[i];
+        bool pass = w->count && w->lo >= w->min_us && (!w->max_us || w->hi <= w->max_us);
+
+        printf("%-6s %-20s %8.2f %8.2f %8.0f ", w->name, w->what, w->lo, w->hi, w->min_us);
+
+        if (w->max_us)
+            printf("%8.0f", w->max_us);
+        else
+            printf("%8s", "-");
+
+        printf(" %7lu  %s\n", w->count, pass ? "PASS" : "FAIL");
+
+        ok = ok && pass;
+    }
+
+    return ok;
+}
+
+static bool check_console(unsigned native, unsigned bridged)
+{
+    const char *found = strstr(_g_console, "Found ");
+    unsigned n;
+    unsigned b;
+
+    if (!found || sscanf(found, "Found %u native and %u bridged", &n, &b) != 2)
+    {
+        printf("Firmware never reported its enumeration\n");
+        return false;
+    }
+
+    printf("Firmware found %u native and %u bridged sensors, expected %u and %u\n", n, b, native, bridged);
+
+    return n == native && b == bridged && !strstr(_g_console, "Error");
+}
+
+int main(int argc, char **argv)
+{
+    static const char *names[SIG_COUNT] = { "ow_line", "ow_master_low", "ow_slave_low" };
+    const char *firmware = "owdemo.elf";
+    const char *trace = "owtrace.vcd";
+    unsigned num_ds18b20 = 1;
+    unsigned num_mcp9808 = 0;
+    unsigned num_veml7700 = 0;
+    unsigned run_ms = 2500;
+    elf_firmware_t f;
+    avr_vcd_t vcd;
+    uint32_t flags;
+    bool ok;
+    int state;
+    unsigned i;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:o:t:m:l:r:h:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'f': firmware = optarg; break;
+        case 'o': trace = optarg; break;
+        case 't': num_ds18b20 = (unsigned)atoi(optarg); break;
+        case 'm': num_mcp9808 = (unsigned)atoi(optarg); break;
+        case 'l': num_veml7700 = (unsigned)atoi(optarg); break;
+        case 'r': run_ms = (unsigned)atoi(optarg); break;
+        case 'h': _g_hold_us = (uint32_t)atoi(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-f elf] [-o vcd] [-t ds18b20] [-m mcp9808] [-l veml7700] [-r run_ms] [-h hold_us]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    memset(&f, 0, sizeof(f));
+
+    if (elf_read_firmware(firmware, &f))
+    {
+        fprintf(stderr, "Can't load %s\n", firmware);
+        return 2;
+    }
+
+    strcpy(f.mmcu, TRACE_MCU);
+    f.frequency = TRACE_FREQUENCY;
+
+    _g_avr = avr_make_mcu_by_name(f.mmcu);
+    if (!_g_avr)
+        return 2;
+
+    avr_init(_g_avr);
+    avr_load_firmware(_g_avr, &f);
+
+    owsim_init(1);
+    for (i = 0; i < num_ds18b20; i++)
+        owsim_add(OWSIM_DS18B20);
+    for (i = 0; i < num_mcp9808; i++)
+        owsim_add(OWSIM_MCP9808);
+    for (i = 0; i < num_veml7700; i++)
+        owsim_add(OWSIM_VEML7700);
+
+    _g_signals = avr_alloc_irq(&_g_avr->irq_pool, 0, SIG_COUNT, names);
+
+    avr_irq_register_notify(avr_io_getirq(_g_avr, AVR_IOCTL_IOPORT_GETIRQ(TRACE_PORT), IOPORT_IRQ_DIRECTION_ALL), ddr_notify, NULL);
+    avr_irq_register_notify(avr_io_getirq(_g_avr, AVR_IOCTL_IOPORT_GETIRQ(TRACE_PORT), IOPORT_IRQ_REG_PORT), port_notify, NULL);
+
+    /* Keep the console off our stdout, it's checked afterwards */
+    avr_ioctl(_g_avr, AVR_IOCTL_UART_GET_FLAGS(TRACE_UART), &flags);
+    flags &= ~AVR_UART_FLAG_STDIO;
+    avr_ioctl(_g_avr, AVR_IOCTL_UART_SET_FLAGS(TRACE_UART), &flags);
+    avr_irq_register_notify(avr_io_getirq(_g_avr, AVR_IOCTL_UART_GETIRQ(TRACE_UART), UART_IRQ_OUTPUT), uart_notify, NULL);
+
+    avr_vcd_init(_g_avr, trace, &vcd, 100 /* us */);
+    avr_vcd_add_signal(&vcd, _g_signals + SIG_LINE, 1, names[SIG_LINE]);
+    avr_vcd_add_signal(&vcd, _g_signals + SIG_MASTER, 1, names[SIG_MASTER]);
+    avr_vcd_add_signal(&vcd, _g_signals + SIG_SLAVE, 1, names[SIG_SLAVE]);
+    avr_vcd_start(&vcd);
+
+    update_line();
+
+    do
+    {
+        state = avr_run(_g_avr);
+    } while (state != cpu_Done && state != cpu_Crashed &&
+        _g_avr->cycle < (avr_cycle_count_t)run_ms * (TRACE_FREQUENCY / 1000));
+
+    avr_vcd_stop(&vcd);
+
+    if (state == cpu_Crashed)
+    {
+        fprintf(stderr, "Firmware crashed\n");
+        return 1;
+    }
+
+    printf("%s: %.1f ms simulated, trace in %s\n\n", firmware, cycles_to_us(_g_avr->cycle) / 1000.0, trace);
+
+    ok = check_windows();
+    printf("\n");
+    ok = check_console(num_ds18b20, num_mcp9808 + num_veml7700) && ok;
+
+    printf("\n%s\n", ok ? "Slot timing OK" : "Slot timing FAILED");
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,377 @@
+/*
+ *   File:   simmain.c
+ *   Author: Matt
+ *
+ *   Host build entry point. Populates the simulated bus, then runs the
+ *   same cycles as the firmware, searching the bus as it goes, and reports
+ *   how much bus time each cost.
+ *
+ *   Usage: owdemo-host [-t ds18b20] [-p parasite] [-m mcp9808] [-l veml7700] [-c cycles] [-s seed]
+ *                      [-a cycle] [-r cycle] [-d cycle] [-o] [-w cycle] [-P]
+ *          owdemo-host -R trace.csv [-s seed]
+ *
+ *   -p makes the first N DS18B20s parasite powered. -a plugs in another
+ *   DS18B20 before the given cycle, and -r unplugs the first device. -d
+ *   dims the light on every VEML7700 to a quarter before the given cycle.
+ *   -o switches the MCP9808s to one-shot conversions at 0.5C once found.
+ *   -w gives the MCP9808s a locked 20-25C alert window once found, and
+ *   warms them to 26C before the given cycle. -P puts the VEML7700s in
+ *   power saving mode once found. The report counters are printed at the
+ *   end.
+ *
+ *   -R replays a temperature log onto a DS18B20 per column, once polling
+ *   every device every cycle and once with the adaptive intervals, and
+ *   compares the bus time each took. Lines are "seconds,C,C,...", with
+ *   # comments. Lag is how far the last value sent trails the trace.
+ *
+ *   Created on 19 October 2026, 17:40
+ *
+ *   This is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *   This software is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *   You should have received a copy of the GNU General Public License
+ *   along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "project.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#include "onewire.h"
+#include "sensors.h"
+#include "drivers.h"
+#include "scheduler.h"
+#include "report.h"
+#include "mcp9808.h"
+#include "timer.h"
+#include "owsim.h"
+
+#define REPLAY_ROWS             4096
+#define REPLAY_COLS             16
+
+typedef struct
+{
+    int rows;
+    int cols;
+    uint32_t ms[REPLAY_ROWS];
+    float temp[REPLAY_ROWS][REPLAY_COLS];
+} replay_t;
+
+typedef struct
+{
+    unsigned cycles;
+    unsigned long readings;
+    unsigned long sent;
+    unsigned long long bus_us;
+    unsigned samples;
+    int worst_lag;                      /* Decicelsius */
+    double total_lag;
+} replay_result_t;
+
+static replay_t _g_replay;
+
+static void print_stats(const char *what)
+{
+    const owsim_stats_t *stats = owsim_get_stats();
+
+    printf("%s: %u resets, %u slots, %llu us on the bus\r\n", what,
+        stats->resets, stats->slots, (unsigned long long)(stats->bus_ns / 1000));
+}
+
+static bool replay_load(const char *path, replay_t *r)
+{
+    FILE *f = fopen(path, "r");
+    char line[512];
+
+    if (!f)
+        return false;
+
+    r->rows = 0;
+    r->cols = 0;
+
+    while (r->rows < REPLAY_ROWS && fgets(line, sizeof(line), f))
+    {
+        char *p = line;
+        char *end;
+        int col = 0;
+
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+
+        r->ms[r->rows] = (uint32_t)(strtod(p, &end) * 1000);
+
+        while (end != p && *end == ',' && col < REPLAY_COLS)
+        {
+            p = end + 1;
+            r->temp[r->rows][col] = strtof(p, &end);
+            if (end != p)
+                col++;
+        }
+
+        if (!r->cols)
+            r->cols = col;
+        if (col != r->cols || !col)
+            break;
+
+        r->rows++;
+    }
+
+    fclose(f);
+    return r->rows > 1;
+}
+
+/* Linear between rows */
+static float replay_at(const replay_t *r, int col, uint32_t ms)
+{
+    int i = 1;
+
+    while (i < r->rows - 1 && r->ms[i] < ms)
+        i++;
+
+    if (ms >= r->ms[i])
+        return r->temp[i][col];
+
+    return r->temp[i - 1][col] + (r->temp[i][col] - r->temp[i - 1][col]) *
+        (float)(ms - r->ms[i - 1]) / (float)(r->ms[i] - r->ms[i - 1]);
+}
+
+static void replay_pass(const replay_t *r, uint32_t seed, replay_result_t *result)
+{
+    report_stats_t before;
+    report_stats_t after;
+    uint8_t id[OW_ROMCODE_SIZE];
+    uint32_t now;
+    int col;
+
+    memset(result, 0, sizeof(*result));
+
+    timer_init();
+    owsim_init(seed);
+
+    for (col = 0; col < r->cols; col++)
+        owsim_set_temp16(owsim_add(OWSIM_DS18B20), (int16_t)(r->temp[0][col] * 16));
+
+    sensors_init();
+    scheduler_init();
+    report_get_stats(&before);
+
+    while ((now = timer_millis()) < r->ms[r->rows - 1])
+    {
+        for (col = 0; col < r->cols; col++)
+            owsim_set_temp16(col, (int16_t)(replay_at(r, col, now) * 16 + (replay_at(r, col, now) < 0 ? -0.5f : 0.5f)));
+
+        scheduler_cycle();
+        result->cycles++;
+
+        /* What a listener on the console would believe now, against the trace */
+        for (col = 0; col < r->cols; col++)
+        {
+            uint8_t idx;
+            uint8_t age;
+            int16_t sent;
+            int lag;
+
+            owsim_get_rom(col, id);
+            idx = sensors_find(id);
+            if (idx == SENSOR_NONE)
+                continue;
+
+            sent = sensors_reported(idx, &age);
+            if (age == SENSOR_REPORT_NONE)
+                continue;
+
+            lag = abs((int)(replay_at(r, col, timer_millis()) * 10 + 0.5f) - sent);
+            if (lag > result->worst_lag)
+                result->worst_lag = lag;
+            result->total_lag += lag;
+            result->samples++;
+        }
+    }
+
+    report_get_stats(&after);
+    result->readings = (after.sent + after.suppressed + after.dropped) - (before.sent + before.suppressed + before.dropped);
+    result->sent = after.sent - before.sent;
+    result->bus_us = owsim_get_stats()->bus_ns / 1000;
+}
+
+static void replay_print(FILE *out, const char *what, const replay_result_t *result)
+{
+    fprintf(out, "%-9s %u cycles, %lu readings, %lu sent, %llu us on the bus, lag %.2fC worst %.1fC\r\n",
+        what, result->cycles, result->readings, result->sent, result->bus_us,
+        result->samples ? result->total_lag / result->samples / 10 : 0.0, result->worst_lag / 10.0);
+}
+
+/* The scheduler's output would drown the comparison, so it goes to /dev/null */
+static int replay(const char *path, uint32_t seed)
+{
+    replay_result_t adaptive;
+    replay_result_t fixed;
+    FILE *out;
+    uint8_t type;
+
+    if (!replay_load(path, &_g_replay))
+    {
+        fprintf(stderr, "Can't read a trace from %s\n", path);
+        return 1;
+    }
+
+    fflush(stdout);
+    out = fdopen(dup(STDOUT_FILENO), "w");
+
+    if (!out || !freopen("/dev/null", "w", stdout))
+        return 1;
+
+    replay_pass(&_g_replay, seed, &adaptive);
+
+    for (type = 0; type < DEV_NUM_TYPES; type++)
+        scheduler_set_intervals(type, 0, 0);
+
+    replay_pass(&_g_replay, seed, &fixed);
+
+    fprintf(out, "Replay of %s: %d sensors over %lu s\r\n", path, _g_replay.cols,
+        (unsigned long)(_g_replay.ms[_g_replay.rows - 1] / 1000));
+    replay_print(out, "Fixed:", &fixed);
+    replay_print(out, "Adaptive:", &adaptive);
+    fprintf(out, "Adaptive polling saved %.0f%% of the bus time\r\n",
+        fixed.bus_us ? 100.0 * ((double)fixed.bus_us - (double)adaptive.bus_us) / (double)fixed.bus_us : 0.0);
+
+    fclose(out);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int num_ds18b20 = 2;
+    int num_parasite = 0;
+    int num_mcp9808 = 1;
+    int num_veml7700 = 1;
+    int cycles = 1;
+    int arrive = -1;
+    int depart = -1;
+    int spare = -1;
+    int dim = -1;
+    int first_veml7700;
+    bool oneshot = false;
+    bool power_saving = false;
+    int warm = -1;
+    bool configured = false;
+    const char *trace = NULL;
+    uint32_t seed = 1;
+    int opt;
+    int i;
+
+    while ((opt = getopt(argc, argv, "t:p:m:l:c:s:a:r:d:ow:PR:")) != -1)
+    {
+        switch (opt)
+        {
+        case 't': num_ds18b20 = atoi(optarg); break;
+        case 'p': num_parasite = atoi(optarg); break;
+        case 'm': num_mcp9808 = atoi(optarg); break;
+        case 'l': num_veml7700 = atoi(optarg); break;
+        case 'c': cycles = atoi(optarg); break;
+        case 's': seed = strtoul(optarg, NULL, 0); break;
+        case 'a': arrive = atoi(optarg); break;
+        case 'r': depart = atoi(optarg); break;
+        case 'd': dim = atoi(optarg); break;
+        case 'o': oneshot = true; break;
+        case 'w': warm = atoi(optarg); break;
+        case 'P': power_saving = true; break;
+        case 'R': trace = optarg; break;
+        default:
+            fprintf(stderr, "Usage: %s [-t ds18b20] [-p parasite] [-m mcp9808] [-l veml7700] [-c cycles] [-s seed] [-a cycle] [-r cycle] [-d cycle] [-o] [-w cycle] [-P] [-R trace.csv]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (trace)
+        return replay(trace, seed);
+
+    timer_init();
+    owsim_init(seed);
+
+    for (i = 0; i < num_ds18b20; i++)
+    {
+        int dev = owsim_add(OWSIM_DS18B20);
+
+        owsim_set_temp16(dev, (int16_t)((18 + i) * 16 + (i & 15)));
+        owsim_set_parasite(dev, i < num_parasite);
+    }
+    for (i = 0; i < num_mcp9808; i++)
+        owsim_set_temp16(owsim_add(OWSIM_MCP9808), (int16_t)((22 + i) * 16 + 4));
+    first_veml7700 = num_ds18b20 + num_mcp9808;
+    for (i = 0; i < num_veml7700; i++)
+        owsim_set_millilux(owsim_add(OWSIM_VEML7700), 250000UL + i * 10000UL);
+
+    if (arrive >= 0)
+    {
+        spare = owsim_add(OWSIM_DS18B20);
+        owsim_set_temp16(spare, 30 * 16);
+        owsim_set_present(spare, false);
+    }
+
+    sensors_init();
+    scheduler_init();
+
+    for (i = 0; i < cycles; i++)
+    {
+        if (i == arrive)
+            owsim_set_present(spare, true);
+        if (i == depart)
+            owsim_set_present(0, false);
+        if (i == dim)
+        {
+            int j;
+
+            for (j = 0; j < num_veml7700; j++)
+                owsim_set_millilux(first_veml7700 + j, (250000UL + j * 10000UL) / 4);
+        }
+
+        if (i == warm)
+        {
+            int j;
+
+            for (j = 0; j < num_mcp9808; j++)
+                owsim_set_temp16(num_ds18b20 + j, 26 * 16);
+        }
+
+        /* Once the first sweep has found them */
+        if (!configured && sensors_sweeps())
+        {
+            uint8_t j;
+
+            for (j = 0; j < sensors_count(); j++)
+            {
+                if (power_saving && sensors_type(j) == DEV_VEML7700)
+                    drivers_veml7700_power_saving(j, true);
+                if (sensors_type(j) != DEV_MPC9808)
+                    continue;
+                if (oneshot)
+                    drivers_mcp9808_mode(j, MCP9808_RES_0_5C, true);
+                if (warm >= 0)
+                    drivers_mcp9808_window(j, 200, 250, 300, true);
+            }
+
+            configured = true;
+        }
+
+        owsim_clear_stats();
+        scheduler_cycle();
+        print_stats("Cycle");
+        printf("\r\n");
+    }
+
+    scheduler_dump_stats();
+    report_dump_stats();
+
+    return 0;
+}
@@ -26,14 +26,17 @@
 
 #include <avr/io.h>
 #include <util/twi.h>
-#include <util/delay.h>
 
 #include "i2c.h"
+#include "timer.h"
 
 #define I2C_PRESCALER 1
 #define I2C_READ    1
 #define I2C_WRITE   0
 
+#define I2C_SYNC_TIMEOUT_US     500
+#define I2C_START_TIMEOUT_MS    5
+
 #ifdef _I2C_
 
 void i2c_init(uint16_t freq_khz)
@@ -44,35 +47,37 @@ void i2c_init(uint16_t freq_khz)
 
 bool i2c_sync(void)
 {
-    uint16_t timeout = 500;
+    uint32_t start = timer_micros();
 
-    while (!(TWCR & _BV(TWINT)) && timeout)
+    while (!(TWCR & _BV(TWINT)))
     {
-        _delay_us(1);
-        timeout--;
+        if (timeout_expired_us(start, I2C_SYNC_TIMEOUT_US))
+            return false;
     }
-    return (timeout != 0);
+
+    return true;
 }
 
 uint8_t i2c_wait_stop(void)
 {
-    uint16_t timeout = 500;
+    uint32_t start = timer_micros();
 
     TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWSTO);
 
-    while ((TWCR & _BV(TWSTO)) && timeout)
+    while (TWCR & _BV(TWSTO))
     {
-        _delay_us(1);
-        timeout--;
+        if (timeout_expired_us(start, I2C_SYNC_TIMEOUT_US))
+            return false;
     }
 
-    return (timeout != 0);
+    return true;
 }
 
 uint8_t i2c_start_wait(uint8_t addr)
 {
     uint8_t twst;
     uint16_t retry = 100;
+    uint32_t start = timer_millis();
 
     while (1)
     {
@@ -104,7 +109,7 @@ uint8_t i2c_start_wait(uint8_t addr)
             if (!i2c_wait_stop())
                 continue;
 
-            if (!(retry--))
+            if (!(retry--) || timeout_expired_ms(start, I2C_START_TIMEOUT_MS))
                 break;
 
             continue;
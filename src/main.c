@@ -36,30 +36,24 @@
 #include "ds18b20.h"
 #include "veml7700.h"
 #include "mcp9808.h"
+#include "sensors.h"
+#include "drivers.h"
+#include "scheduler.h"
+#include "report.h"
 #include "usart.h"
+#include "timer.h"
 #include "util.h"
 
 FILE uart_str = FDEV_SETUP_STREAM(print_char, NULL, _FDEV_SETUP_RW);
 
 static void io_init(void);
 
-#define DEV_UNKNOWN     0
-#define DEV_DS18B20     1
-#define DEV_VEML7700    2
-#define DEV_MPC9808     3
-
 int main(void)
 {
-    uint8_t i;
-    uint8_t sensor_ids[MAX_SENSORS][OW_ROMCODE_SIZE];
-    uint8_t dev_types[MAX_SENSORS];
-    uint8_t num_sensors;
-    uint8_t num_temp_sensors;
-    uint8_t num_bridged_devs;
-    uint8_t ow_device_types[2];
-    uint8_t ow_device_counts[2];
+    onewire_timing_t ow_timing;
 
     io_init();
+    timer_init();
     g_irq_enable();
 
     usart1_open(USART_CONT_RX, (((F_CPU / UART1_BAUD) / 16) - 1)); // Console
@@ -68,122 +62,33 @@ int main(void)
 
     printf("Starting up...\r\n");
 
-    ow_device_types[0] = DS18B20_FAMILY_CODE;
-    ow_device_types[1] = DS28E17_FAMILY_CODE;
-
-    if (!onewire_search_devices(sensor_ids, ow_device_types, ow_device_counts, sizeof(ow_device_types)))
-        printf("Hardware error searching for sensors\r\n");
-
-    num_temp_sensors = ow_device_counts[0];
-    num_bridged_devs = ow_device_counts[1];
-    num_sensors = num_temp_sensors + num_bridged_devs;
-
-    if (num_bridged_devs)
+    if (ow_calibrate(&ow_timing))
     {
-        for (i = 0; i < num_sensors; i++)
-        {
-            dev_types[i] = DEV_UNKNOWN;
-
-            if (sensor_ids[i][0] == DS28E17_FAMILY_CODE)
-            {
-                ds28e17_init(sensor_ids[i]);
-
-                if (mcp9808_present(sensor_ids[i]))
-                {
-                    dev_types[i] = DEV_MPC9808;
-                }
-                else
-                {
-                    dev_types[i] = DEV_VEML7700; //Can't easily probe VEML7700 so assume it's this if not MCP9808
-                    veml7700_init(sensor_ids[i]);
-                }
-            }
-
-            if (sensor_ids[i][0] == DS18B20_FAMILY_CODE)
-            {
-                dev_types[i] = DEV_DS18B20;
-            }
-        }
+        printf("1-Wire rise time %u us: recovery %u us, sample at %u us\r\n", ow_timing.rise_us, ow_timing.recovery_us, ow_timing.sample_us);
+        printf("Byte time %u us, was %u us\r\n", ow_timing.byte_us, ow_timing.default_byte_us);
     }
 
-    printf("Found %u native and %u bridged sensors of %u total\r\n\r\n", num_temp_sensors, num_bridged_devs, MAX_SENSORS);
+    printf("Sensor table uses %u bytes per device, %u bytes total\r\n", SENSOR_BYTES_PER_DEVICE, SENSOR_BYTES_PER_DEVICE * SENSOR_MAX);
+    printf("Press 's' for error, scheduler, report and stack statistics\r\n\r\n");
+
+    /* The bus is searched a pass at a time by the scheduler, so sampling starts with the first devices found */
+    sensors_init();
+    scheduler_init();
 
     for (;;)
     {
-        for (i = 0; i < num_sensors; i++)
-        {
-            // Don't broadcast 'start measure' command. DS28E17's don't know what to do with it.
-            if (sensor_ids[i][0] == DS18B20_FAMILY_CODE)
-            {
-                if (!ds18b20_start_measure(sensor_ids[i]))
-                    printf("Error starting measurement on temperature sensor %d\r\n", i);
-            }
-        }
-
-        _delay_ms(1000);
-
-        for (i = 0; i < num_sensors; i++)
+        if (console_data_ready() && console_get() == 's')
         {
-            if (dev_types[i] == DEV_DS18B20)
-            {
-                int16_t temperature; // single fixed point i.e. 10 = 1.0 degrees
-
-                if (ds18b20_read_decicelsius(sensor_ids[i], (int16_t *)&temperature))
-                {
-                    char temperature_sign[2];
-                    
-                    temperature_sign[1] = 0;
-                    temperature_sign[0] = (temperature < 0)  ? '-' : 0;
-                        
-                    printf("DS18B20 sensor     @ Index %d: Degrees C: %s%u.%u\r\n", i, temperature_sign, (abs(temperature) / 10), (abs(temperature) % 10));
-                }
-                else
-                {
-                    printf("Error reading from DS18B20 sensor %d\r\n", i);
-                }
-            }
-            else if (dev_types[i] == DEV_MPC9808)
-            {
-                int16_t temperature; // single fixed point i.e. 10 = 1.0 degrees
-
-                if (mcp9808_read_decicelsius(sensor_ids[i], (int16_t *)&temperature))
-                {
-                    char temperature_sign[2];
-                    
-                    temperature_sign[1] = 0;
-                    temperature_sign[0] = (temperature < 0)  ? '-' : 0;
-                        
-                    printf("MCP9808 sensor     @ Index %d: Degrees C: %s%u.%u\r\n", i, temperature_sign, (abs(temperature) / 10), (abs(temperature) % 10));
-                }
-                else
-                {
-                    printf("Error reading from MPC9808 sensor %d\r\n", i);
-                }
-            }
-            else if (dev_types[i] == DEV_VEML7700)
-            {
-                uint32_t lux; // single fixed point. i.e. 10 = 1.0 lux
-
-                if (veml7700_read_decilux(sensor_ids[i], (uint32_t *)&lux))
-                {
-                    printf("VEML7700 sensor    @ Index %d:       Lux: %lu.%lu\r\n", i, (lux / 10), (lux % 10));
-                }
-                else
-                {
-                    printf("Error reading from VEML7700 sensor %d\r\n", i);
-                }
-            }
-            else
-            {
-                printf("Unknown sensor     @ Index %d\r\n", i);
-            }
+            sensors_dump_stats();
+            scheduler_dump_stats();
+            report_dump_stats();
+            printf("Stack: %u bytes never used\r\n", stack_unused());
         }
 
-        printf("\r\n");
+        scheduler_cycle();
     }
 }
 
-
 static void io_init(void)
 {
 #ifdef _LEONARDO_
@@ -22,9 +22,11 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <avr/pgmspace.h>
 
 #include "mcp9808.h"
 #include "ds28e17.h"
+#include "fixedpoint.h"
 #include "util.h"
 
 #define MCP9808_REG_CONFIG             0x01
@@ -45,8 +47,21 @@
 #define MCP9808_REG_AMBIENT_TEMP       0x05
 #define MCP9808_REG_MANUF_ID           0x06
 #define MCP9808_REG_DEVICE_ID          0x07
+#define MCP9808_REG_RESOLUTION         0x08
 
-bool mcp9808_present(uint8_t *host)
+#define MCP9808_AMBIENT_ALERT_SHIFT    5
+#define MCP9808_AMBIENT_ALERT_MASK     0x07
+#define MCP9808_AMBIENT_MASK           0x0FFF
+#define MCP9808_AMBIENT_SIGN           0x1000
+#define MCP9808_AMBIENT_RANGE          0x1000
+
+/* Limits are 0.25C steps of a 13 bit two's complement value in sixteenths */
+#define MCP9808_LIMIT_MASK             0x1FFC
+
+/* Conversion time at each resolution, in ms */
+static const uint8_t _g_conv_ms[] PROGMEM = { 30, 65, 130, 250 };
+
+bool mcp9808_present(const uint8_t *host)
 {
     uint16_t manuf;
     uint16_t device;
@@ -67,23 +82,97 @@ bool mcp9808_present(uint8_t *host)
     return false;
 }
 
-bool mcp9808_read_decicelsius(uint8_t *host, int16_t *result)
+bool mcp9808_set_resolution(const uint8_t *host, uint8_t resolution)
+{
+    return ds28e17_i2c_write(host, MCP9808_I2CADDR_BASE, MCP9808_REG_RESOLUTION, &resolution, sizeof(uint8_t));
+}
+
+/*
+ * There's no one-shot bit. Leaving shutdown starts continuous conversion,
+ * the first result being ready a conversion time later.
+ */
+bool mcp9808_shutdown(const uint8_t *host, bool shutdown)
+{
+    uint16_t config = SWAP16(shutdown ? MCP9808_REG_CONFIG_SHUTDOWN : 0);
+
+    return ds28e17_i2c_write(host, MCP9808_I2CADDR_BASE, MCP9808_REG_CONFIG, (uint8_t *)&config, sizeof(uint16_t));
+}
+
+/*
+ * Limits in decicelsius, truncated to 0.25C steps. Locking holds them, and
+ * the critical limit, until the part is next powered up. A locked part
+ * can't be shut down, so isn't for one-shot use.
+ */
+bool mcp9808_set_window(const uint8_t *host, int16_t lower, int16_t upper, int16_t crit, bool lock)
+{
+    static const uint8_t regs[] = { MCP9808_REG_LOWER_TEMP, MCP9808_REG_UPPER_TEMP, MCP9808_REG_CRIT_TEMP };
+    int16_t limits[] = { lower, upper, crit };
+    uint16_t value;
+    uint8_t i;
+
+    for (i = 0; i < sizeof(regs); i++)
+    {
+        value = ((uint16_t)(limits[i] * 8 / 5)) & MCP9808_LIMIT_MASK;
+        value = SWAP16(value);
+
+        if (!ds28e17_i2c_write(host, MCP9808_I2CADDR_BASE, regs[i], (uint8_t *)&value, sizeof(uint16_t)))
+            return false;
+    }
+
+    if (!lock)
+        return true;
+
+    value = SWAP16(MCP9808_REG_CONFIG_WINLOCKED | MCP9808_REG_CONFIG_CRITLOCKED);
+
+    return ds28e17_i2c_write(host, MCP9808_I2CADDR_BASE, MCP9808_REG_CONFIG, (uint8_t *)&value, sizeof(uint16_t));
+}
+
+/*
+ * The window flags lead the ambient register, so a one byte read
+ * fetches them without the temperature.
+ */
+bool mcp9808_read_alerts(const uint8_t *host, uint8_t *alerts)
+{
+    uint8_t upper;
+
+    if (!ds28e17_i2c_read(host, MCP9808_I2CADDR_BASE, MCP9808_REG_AMBIENT_TEMP, &upper, sizeof(uint8_t)))
+        return false;
+
+    *alerts = (upper >> MCP9808_AMBIENT_ALERT_SHIFT) & MCP9808_AMBIENT_ALERT_MASK;
+    return true;
+}
+
+/* Typical figures, so allow an eighth more */
+uint16_t mcp9808_conv_ms(uint8_t resolution)
+{
+    uint16_t ms = pgm_read_byte(&_g_conv_ms[resolution]);
+
+    return ms + (ms >> 3);
+}
+
+/* Also returns the window flags, MCP9808_ALERT_xxx */
+bool mcp9808_read_decicelsius(const uint8_t *host, int16_t *result, uint8_t *alerts)
 {
     uint16_t ambient;
-    int32_t decicelsius;
 
     if (!ds28e17_i2c_read(host, MCP9808_I2CADDR_BASE, MCP9808_REG_AMBIENT_TEMP, (uint8_t *)&ambient, sizeof(uint16_t)))
         return false;
 
     ambient = SWAP16(ambient);
 
-    decicelsius = (ambient & 0x0FFF) * 10;
-    decicelsius /= 16;
-    
-    if (ambient & 0x1000)
-        decicelsius -= 2560;
-
-    *result = (int16_t)decicelsius;
+    *result = mcp9808_ambient_to_decicelsius(ambient);
+    *alerts = (ambient >> (8 + MCP9808_AMBIENT_ALERT_SHIFT)) & MCP9808_AMBIENT_ALERT_MASK;
 
     return true;
 }
+
+/* The temperature is 13 bit two's complement, in sixteenths. Rounds down */
+int16_t mcp9808_ambient_to_decicelsius(uint16_t ambient)
+{
+    int16_t sixteenths = ambient & MCP9808_AMBIENT_MASK;
+
+    if (ambient & MCP9808_AMBIENT_SIGN)
+        sixteenths -= MCP9808_AMBIENT_RANGE;
+
+    return fixedpoint_q4_to_deci_floor(sixteenths);
+}
@@ -26,7 +26,25 @@
 
 #define MCP9808_I2CADDR_BASE           0x18
 
-bool mcp9808_present(uint8_t *host);
-bool mcp9808_read_decicelsius(uint8_t *host, int16_t *result);
+/* Resolution register values, from 0.5C in 30ms up to 0.0625C in 250ms */
+#define MCP9808_RES_0_5C               0
+#define MCP9808_RES_0_25C              1
+#define MCP9808_RES_0_125C             2
+#define MCP9808_RES_0_0625C            3
+#define MCP9808_RES_DEFAULT            MCP9808_RES_0_0625C
+
+/* Window flags, from the upper byte of the ambient register */
+#define MCP9808_ALERT_LOWER            0x01    /* Below the lower limit */
+#define MCP9808_ALERT_UPPER            0x02    /* Above the upper limit */
+#define MCP9808_ALERT_CRIT             0x04    /* At or above the critical limit */
+
+bool mcp9808_present(const uint8_t *host);
+bool mcp9808_set_resolution(const uint8_t *host, uint8_t resolution);
+bool mcp9808_shutdown(const uint8_t *host, bool shutdown);
+uint16_t mcp9808_conv_ms(uint8_t resolution);
+bool mcp9808_set_window(const uint8_t *host, int16_t lower, int16_t upper, int16_t crit, bool lock);
+bool mcp9808_read_alerts(const uint8_t *host, uint8_t *alerts);
+bool mcp9808_read_decicelsius(const uint8_t *host, int16_t *result, uint8_t *alerts);
+int16_t mcp9808_ambient_to_decicelsius(uint16_t ambient);
 
 #endif /* __MCP9808_H__ */
@@ -24,13 +24,187 @@
 #include "onewire.h"
 #include "ow_bitbang.h"
 #include "ds2482.h"
+#include "crc8.h"
+#include "crc16_arc.h"
+#include "timer.h"
 
 #define OW_SEARCH_FIRST           0xFF
 #define OW_PRESENCE_ERR           0xFF
 #define OW_DATA_ERR               0xFE
 #define OW_LAST_DEVICE            0x00
 
-static int8_t match_family_code(uint8_t family_code, uint8_t *family_codes, uint8_t len)
+static uint8_t _g_ow_error;
+static uint8_t _g_ow_devices;  /* Found by the last complete search, 0 if unknown */
+
+void onewire_clear_error(void)
+{
+    _g_ow_error = OW_ERR_NONE;
+}
+
+/* Only the first cause is kept. Later failures are usually knock-on effects */
+void onewire_error(uint8_t err)
+{
+    /* Someone may have left or joined */
+    if (err == OW_ERR_PRESENCE || err == OW_ERR_CRC)
+        onewire_bus_changed();
+
+    if (_g_ow_error == OW_ERR_NONE)
+        _g_ow_error = err;
+}
+
+uint8_t onewire_last_error(void)
+{
+    return _g_ow_error;
+}
+
+/*
+ * With exactly one device on the bus, Skip ROM addresses it as well as
+ * Match ROM does, and saves 64 slots per transaction.
+ */
+bool onewire_single_drop(void)
+{
+    return _g_ow_devices == 1;
+}
+
+/* Address by ROM until the next search says otherwise */
+void onewire_bus_changed(void)
+{
+    _g_ow_devices = 0;
+}
+
+static bool onewire_wait_us(uint16_t us)
+{
+    uint32_t start = timer_micros();
+
+    while (!timeout_expired_us(start, us));
+
+    return true;
+}
+
+static bool onewire_poll(const onewire_op_t *op)
+{
+    uint32_t start = timer_micros();
+    bool bit;
+
+    for (;;)
+    {
+        bit = true;
+        if (!ow_bit_io(&bit))
+            return false;
+        if (!bit)
+            return true;
+
+        if (timeout_expired_us(start, op->us))
+            break;
+
+        onewire_wait_us(op->len);
+    }
+
+    onewire_error(OW_ERR_TIMEOUT);
+    return false;
+}
+
+/*
+ * Consecutive writes, and the CRC after them if there is one, go out as
+ * one ow_writev() call where they fit in OW_OP_MAX_SEGS. Longer runs go
+ * out in chunks and the CRC, carried in *sum across them, is written at
+ * the end. Leaves *op at the first step not consumed.
+ */
+static bool onewire_run_writes(const onewire_op_t **op, uint16_t *sum, bool *split)
+{
+    onewire_seg_t seg[OW_OP_MAX_SEGS];
+    uint8_t nseg = 0;
+    uint8_t out[2];
+    uint8_t i;
+
+    while ((*op)->op == OW_OP_WRITE && nseg < OW_OP_MAX_SEGS)
+    {
+        seg[nseg].data = (*op)->p.out;
+        seg[nseg].len = (*op)->len;
+        nseg++;
+        (*op)++;
+    }
+
+    if ((*op)->op == OW_OP_CRC && !*split)
+    {
+        (*op)++;
+        return ow_writev(seg, nseg, true);
+    }
+
+    *split = true;
+    for (i = 0; i < nseg; i++)
+        *sum = crc16_arc(*sum, seg[i].data, seg[i].len);
+
+    if (nseg && !ow_writev(seg, nseg, false))
+        return false;
+
+    if ((*op)->op != OW_OP_CRC)
+        return true;
+
+    (*op)++;
+    out[0] = (uint8_t)~*sum;
+    out[1] = (uint8_t)(~*sum >> 8);
+    return ow_write(out, sizeof(out));
+}
+
+/*
+ * Runs every transaction in the list back to back. One which fails is
+ * abandoned at that step and the next one starts at its OW_OP_SELECT.
+ * Returns the number of transactions which failed.
+ */
+uint8_t onewire_run(const onewire_op_t *op)
+{
+    uint8_t failed = 0;
+    uint16_t sum = CRC16_ARC_INIT;
+    bool split = false;
+    bool ok;
+
+    while (op->op != OW_OP_END)
+    {
+        switch (op->op)
+        {
+        case OW_OP_SELECT:
+            ok = ow_select(op->p.out);
+            sum = CRC16_ARC_INIT;
+            split = false;
+            op++;
+            break;
+        case OW_OP_WRITE:
+        case OW_OP_CRC:
+            ok = onewire_run_writes(&op, &sum, &split);
+            break;
+        case OW_OP_READ:
+            ok = ow_read(op->p.in, op->len);
+            op++;
+            break;
+        case OW_OP_POLL:
+            ok = onewire_poll(op);
+            op++;
+            break;
+        case OW_OP_DELAY:
+            ok = onewire_wait_us(op->us);
+            op++;
+            break;
+        default:
+            ok = false;
+            op++;
+            break;
+        }
+
+        if (ok)
+            continue;
+
+        failed++;
+
+        /* Skip to the next transaction */
+        while (op->op != OW_OP_SELECT && op->op != OW_OP_END)
+            op++;
+    }
+
+    return failed;
+}
+
+int8_t onewire_match_family(uint8_t family_code, const uint8_t *family_codes, uint8_t len)
 {
     uint8_t i;
     for (i = 0; i < len; i++)
@@ -42,73 +216,90 @@ static int8_t match_family_code(uint8_t family_code, uint8_t *family_codes, uint
     return -1;
 }
 
-static bool onewire_find_device(uint8_t *diff, uint8_t *id, uint8_t *family_codes, uint8_t family_codes_len)
+void onewire_search_begin(onewire_search_t *search)
 {
-    uint8_t go = 1;
+    search->diff = OW_SEARCH_FIRST;
+    search->found = 0;
+}
 
-    do
-    {
-        *diff = ow_rom_search(*diff, id);
-        if (*diff == OW_PRESENCE_ERR || *diff == OW_DATA_ERR || *diff == OW_LAST_DEVICE)
-        {
-            go = 0;
-        }
-        else if (*diff == OW_COMMS_ERR)
-        {
-            return false;
-        }
-        else
-        {
-            if (match_family_code(id[0], family_codes, family_codes_len) >= 0)
-                go = 0;
-        }
-    } while (go);
+/*
+ * One search pass, finding one device. The state is kept in search, so
+ * passes can be spread out between other bus traffic. Once a sweep
+ * finishes, the next call starts another.
+ */
+uint8_t onewire_search_step(onewire_search_t *search)
+{
+    uint8_t first;
 
-    return true;
+    if (search->diff == OW_LAST_DEVICE)
+        onewire_search_begin(search);
+
+    first = search->diff == OW_SEARCH_FIRST;
+
+    search->diff = ow_rom_search(search->diff, search->id);
+
+    switch (search->diff)
+    {
+    case OW_COMMS_ERR:
+        onewire_search_begin(search);
+        return OW_STEP_COMMS;
+    case OW_PRESENCE_ERR:
+        onewire_search_begin(search);
+        if (!first)
+            return OW_STEP_ABORT;
+        /* Nobody there is a finished sweep */
+        search->diff = OW_LAST_DEVICE;
+        _g_ow_devices = 0;
+        return OW_STEP_EMPTY;
+    case OW_DATA_ERR:
+        /* Someone left or joined mid pass */
+        onewire_search_begin(search);
+        onewire_bus_changed();
+        return OW_STEP_ABORT;
+    case OW_LAST_DEVICE:
+        search->found++;
+        _g_ow_devices = search->found;
+        return OW_STEP_LAST;
+    default:
+        search->found++;
+        return OW_STEP_FOUND;
+    }
 }
 
-bool onewire_search_devices(uint8_t(*sensor_ids)[OW_ROMCODE_SIZE], uint8_t *family_codes, uint8_t *counts, uint8_t family_codes_len)
+bool onewire_search_devices(onewire_found_t found, uint8_t *family_codes, uint8_t *counts, uint8_t family_codes_len)
 {
-    bool presense;
+    onewire_search_t search;
+    uint8_t step;
     uint8_t i;
-    uint8_t total = 0;
-    uint8_t id[OW_ROMCODE_SIZE];
-    uint8_t diff;
-    
+    int8_t family_matched;
+
     for (i = 0; i < family_codes_len; i++)
         counts[i] = 0;
-    
-    if (!ow_bus_reset(&presense))
-        return false;
-    if (!presense)
-        return true;
-    
-    diff = OW_SEARCH_FIRST;
 
-    while (diff != OW_LAST_DEVICE && total < MAX_SENSORS)
+    onewire_search_begin(&search);
+
+    /* Walk the whole bus, even once the caller is full, so that every device is accounted for */
+    do
     {
-        int8_t family_matched;
+        step = onewire_search_step(&search);
 
-        if (!onewire_find_device(&diff, id, family_codes, family_codes_len))
+        if (step == OW_STEP_COMMS)
             return false;
-        
-        if (diff == OW_PRESENCE_ERR)
-            break;
-        if (diff == OW_DATA_ERR)
+
+        if (step != OW_STEP_FOUND && step != OW_STEP_LAST)
             break;
 
-        family_matched = match_family_code(id[0], family_codes, family_codes_len);
+        family_matched = onewire_match_family(search.id[0], family_codes, family_codes_len);
 
         if (family_matched < 0)
             continue;
 
-        counts[family_matched]++;
-        
-        for (i = 0; i < OW_ROMCODE_SIZE; i++)
-            sensor_ids[total][i] = id[i];
+        if (crc8(search.id, OW_ROMCODE_SIZE))
+            continue;
 
-        total++;
-    }
+        if (found(search.id, (uint8_t)family_matched))
+            counts[family_matched]++;
+    } while (step != OW_STEP_LAST);
 
     return true;
 }
@@ -32,7 +32,98 @@
 
 #define OW_ROMCODE_SIZE 8
 
-bool onewire_search_devices(uint8_t(*sensor_ids)[OW_ROMCODE_SIZE], uint8_t *family_codes, uint8_t *counts, uint8_t family_codes_len);
+/* Each converting DS18B20 draws up to 1.5mA from the strong pull-up. Budgets are in mA */
+#define OW_SPU_BITBANG_MA   20          /* AVR pin sourcing high */
+#define OW_SPU_DS2482_MA    10          /* Conservative for the DS2482 pull-up FET */
+
+/* Cause of the first failure since onewire_clear_error() */
+#define OW_ERR_NONE     0
+#define OW_ERR_PRESENCE 1           /* Nobody answered the reset */
+#define OW_ERR_CRC      2           /* Bad data from the device */
+#define OW_ERR_BRIDGE   3           /* DS28E17 reported an I2C side failure */
+#define OW_ERR_TIMEOUT  4           /* Busy too long, or the bus master stopped responding */
+#define OW_NUM_ERRORS   4
+
+/* Bus timing chosen by ow_calibrate() */
+typedef struct
+{
+    uint8_t rise_us;            /* Worst rise time seen after releasing the line */
+    uint8_t recovery_us;        /* High time between slots */
+    uint8_t sample_us;          /* Falling edge to sample point in read slots */
+    uint16_t byte_us;           /* Resulting bus time per byte */
+    uint16_t default_byte_us;   /* Bus time per byte with the compiled in defaults */
+} onewire_timing_t;
+
+/* One piece of a frame for ow_writev() */
+typedef struct
+{
+    const uint8_t *data;
+    uint8_t len;
+} onewire_seg_t;
+
+/*
+ * Transaction steps for onewire_run(). A list holds one or more
+ * transactions, each starting with OW_OP_SELECT, and ends with OW_OP_END.
+ */
+#define OW_OP_END       0
+#define OW_OP_SELECT    1           /* Reset, then Match ROM out, or Skip ROM if out is NULL */
+#define OW_OP_WRITE     2           /* len bytes from out */
+#define OW_OP_CRC       3           /* Inverted CRC16 of the writes since the select */
+#define OW_OP_READ      4           /* len bytes into in */
+#define OW_OP_POLL      5           /* Read slots every len us until one reads 0, for up to us */
+#define OW_OP_DELAY     6           /* Wait us */
+
+/* Writes merged into one ow_writev() call */
+#define OW_OP_MAX_SEGS  4
+
+typedef struct
+{
+    uint8_t op;                     /* OW_OP_xxx */
+    uint8_t len;
+    uint16_t us;
+    union
+    {
+        const uint8_t *out;
+        uint8_t *in;
+    } p;
+} onewire_op_t;
+
+#define OW_TXN_SELECT(id)           { .op = OW_OP_SELECT, .p.out = (id) }
+#define OW_TXN_WRITE(data, n)       { .op = OW_OP_WRITE, .len = (n), .p.out = (data) }
+#define OW_TXN_CRC()                { .op = OW_OP_CRC }
+#define OW_TXN_READ(buf, n)         { .op = OW_OP_READ, .len = (n), .p.in = (buf) }
+#define OW_TXN_POLL(every, timeout) { .op = OW_OP_POLL, .len = (every), .us = (timeout) }
+#define OW_TXN_DELAY(t)             { .op = OW_OP_DELAY, .us = (t) }
+#define OW_TXN_END()                { .op = OW_OP_END }
+
+/* Outcome of onewire_search_step() */
+#define OW_STEP_FOUND   0           /* id holds a device, more to come */
+#define OW_STEP_LAST    1           /* id holds the last device, the sweep is complete */
+#define OW_STEP_EMPTY   2           /* Nobody on the bus, the sweep is complete */
+#define OW_STEP_ABORT   3           /* The bus changed mid sweep, it starts again */
+#define OW_STEP_COMMS   4           /* The bus master failed, the sweep starts again */
+
+/* Search state kept between onewire_search_step() calls */
+typedef struct
+{
+    uint8_t diff;                   /* OW_SEARCH_FIRST at the start of a sweep */
+    uint8_t found;                  /* Devices seen so far this sweep */
+    uint8_t id[OW_ROMCODE_SIZE];    /* Last device found, and the path for the next pass */
+} onewire_search_t;
+
+/* Called for each device found. Return false if the device couldn't be stored */
+typedef bool (*onewire_found_t)(const uint8_t *id, uint8_t family_index);
+
+void onewire_clear_error(void);
+void onewire_error(uint8_t err);
+uint8_t onewire_last_error(void);
+bool onewire_single_drop(void);
+void onewire_bus_changed(void);
+uint8_t onewire_run(const onewire_op_t *op);
+bool onewire_search_devices(onewire_found_t found, uint8_t *family_codes, uint8_t *counts, uint8_t family_codes_len);
+int8_t onewire_match_family(uint8_t family_code, const uint8_t *family_codes, uint8_t len);
+void onewire_search_begin(onewire_search_t *search);
+uint8_t onewire_search_step(onewire_search_t *search);
 
 #ifdef _OW_BITBANG_
 
@@ -40,9 +131,14 @@ bool onewire_search_devices(uint8_t(*sensor_ids)[OW_ROMCODE_SIZE], uint8_t *fami
 #define ow_bus_reset(presense) owbitbang_bus_reset(presense)
 #define ow_select(id) owbitbang_select(id)
 #define ow_write(data, len) owbitbang_write(data, len)
+#define ow_writev(seg, nseg, crc) owbitbang_writev(seg, nseg, crc)
 #define ow_read(data, len) owbitbang_read(data, len)
 #define ow_bit_io(bit) owbitbang_bit_io(bit)
 #define ow_rom_search(diff, id) owbitbang_rom_search(diff, id)
+#define ow_calibrate(timing) owbitbang_calibrate(timing)
+#define ow_write_pullup(data, len) owbitbang_write_pullup(data, len)
+#define ow_pullup_off() owbitbang_pullup_off()
+#define OW_SPU_BUDGET_MA OW_SPU_BITBANG_MA
 
 #endif /* _OW_BITBANG_ */
 
@@ -52,10 +148,34 @@ bool onewire_search_devices(uint8_t(*sensor_ids)[OW_ROMCODE_SIZE], uint8_t *fami
 #define ow_bus_reset(presense) ds2482_bus_reset(presense)
 #define ow_select(id) ds2482_select(id)
 #define ow_write(data, len) ds2482_write(data, len)
+#define ow_writev(seg, nseg, crc) ds2482_writev(seg, nseg, crc)
 #define ow_read(data, len) ds2482_read(data, len)
 #define ow_bit_io(bit) ds2482_bit_io(bit)
 #define ow_rom_search(diff, id) ds2482_rom_search(diff, id)
+#define ow_calibrate(timing) (false) /* The DS2482 times its own slots */
+#define ow_write_pullup(data, len) ds2482_write_pullup(data, len)
+#define ow_pullup_off() ds2482_pullup_off()
+#define OW_SPU_BUDGET_MA OW_SPU_DS2482_MA
 
 #endif /* _OW_DS2482_ */
 
+#ifdef _OW_SIM_
+
+#include "owsim.h"
+
+#define ow_init()
+#define ow_bus_reset(presense) owsim_bus_reset(presense)
+#define ow_select(id) owsim_select(id)
+#define ow_write(data, len) owsim_write(data, len)
+#define ow_writev(seg, nseg, crc) owsim_writev(seg, nseg, crc)
+#define ow_read(data, len) owsim_read(data, len)
+#define ow_bit_io(bit) owsim_bit_io(bit)
+#define ow_rom_search(diff, id) owsim_rom_search(diff, id)
+#define ow_calibrate(timing) (false)
+#define ow_write_pullup(data, len) owsim_write_pullup(data, len)
+#define ow_pullup_off() owsim_pullup_off()
+#define OW_SPU_BUDGET_MA OW_SPU_BITBANG_MA
+
+#endif /* _OW_SIM_ */
+
 #endif /* __ONEWIRE_H__ */
@@ -25,10 +25,12 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include <util/delay.h>
+#include <util/delay_basic.h>
 
 #include "iopins.h"
 #include "onewire.h"
 #include "ow_bitbang.h"
+#include "crc16_arc.h"
 
 #ifdef _OW_BITBANG_
 
@@ -47,38 +49,160 @@
  */
 #define OW_RECOVERY_TIME         20  /* usec */
 
+/*
+ * owbitbang_calibrate() measures how long the line takes to rise after
+ * the end of a reset and picks the recovery and sample point from that.
+ * Twice the rise time plus a microsecond, kept within these limits.
+ * A line which takes longer than OW_RISE_MAX keeps the defaults.
+ * The slot start in ow_bitbang_asm.S samples at a fixed point, so only
+ * the recovery applies to it.
+ *
+ * Whatever the line allows, slots are never shorter than the slowest
+ * device the bus may carry wants. DS28E17 bridges need tREC >= 5us and
+ * tSLOT >= 65us at standard speed, stricter than the DS18B20.
+ */
+#define OW_DEVICE_TREC_MIN       5   /* usec, DS28E17 */
+#define OW_DEVICE_TSLOT_MIN      65  /* usec, DS28E17 */
+#define OW_RECOVERY_MAX          60  /* usec */
+#define OW_SAMPLE_MIN            10  /* usec, never sample before the slave has surely responded */
+#define OW_SAMPLE_MAX            15  /* usec, tRDV */
+#define OW_RELEASE_TIME          2   /* usec, low time of a write 1 / read slot */
+#define OW_SLOT_TIME             58  /* usec, falling edge to release of a write 0 */
+#define OW_RISE_MAX              12  /* usec */
+#define OW_CALIBRATE_PASSES      4
+
+/* A slot is OW_SLOT_TIME plus the recovery */
+#define OW_RECOVERY_MIN          ((OW_DEVICE_TSLOT_MIN - OW_SLOT_TIME) > OW_DEVICE_TREC_MIN ? \
+                                  (OW_DEVICE_TSLOT_MIN - OW_SLOT_TIME) : OW_DEVICE_TREC_MIN)
+
+/* Each pass of the rise loop is a 1us delay plus the pin test, increment, compare and branch */
+#define OW_CYCLES_PER_US         (F_CPU / 1000000UL)
+#define OW_RISE_LOOP_CYCLES      6
+
+/* Presence is polled from 30us after release until 270us */
+#define OW_PRESENCE_SETTLE       30  /* usec */
+#define OW_PRESENCE_POLL_US      4
+#define OW_PRESENCE_POLLS        (240 / OW_PRESENCE_POLL_US)
+
+#define OW_BYTE_TIME(recovery)   (8 * (OW_SLOT_TIME + (recovery)))
+
+static onewire_timing_t _g_timing = { 0, OW_RECOVERY_TIME, OW_SAMPLE_MAX, OW_BYTE_TIME(OW_RECOVERY_TIME), OW_BYTE_TIME(OW_RECOVERY_TIME) };
+
+#ifdef _OW_BITBANG_ASM_
+/* Drive low, release for a 1 and sample, with interrupts off. Returns the sampled bit */
+uint8_t owbitbang_slot_prefix(uint8_t b);
+#endif
+
 bool owbitbang_bus_idle()
 {
     return OW_GET_IN();
 }
 
-bool owbitbang_bus_reset(bool *presense_detect)
+/* Runtime delay for the calibrated times. 4 cycles per loop */
+static void owbitbang_delay_us(uint8_t us)
+{
+    if (us)
+        _delay_loop_2((uint16_t)us * (F_CPU / 4000000UL));
+}
+
+bool owbitbang_calibrate(onewire_timing_t *timing)
 {
-    bool ret;
     uint8_t intsave;
+    uint8_t pass;
+    uint8_t rise;
+    uint8_t worst = 0;
+
+    for (pass = 0; pass < OW_CALIBRATE_PASSES; pass++)
+    {
+        OW_OUT_LOW();
+        OW_DIR_OUT();
+        _delay_us(240);
+        _delay_us(240);
+
+        intsave = (SREG & _BV(SREG_I)) == _BV(SREG_I);
+        g_irq_disable();
+
+        OW_DIR_IN();
+        OW_OUT_HIGH();
+
+        /* Presence can't start until 15us after release, so this only sees the pull-up */
+        for (rise = 0; !OW_GET_IN() && rise <= OW_RISE_MAX; rise++)
+            _delay_us(1);
+
+        if (intsave)
+            g_irq_enable();
+
+        /* Let the presence pulse come and go, as for any other reset */
+        _delay_us(240);
+        _delay_us(240);
+
+        if (rise > worst)
+            worst = rise;
+    }
+
+    *timing = _g_timing;
+
+    if (worst > OW_RISE_MAX)
+    {
+        timing->rise_us = worst;
+        return false;
+    }
+
+    // Loop passes to microseconds, rounding up
+    worst = (worst * (OW_CYCLES_PER_US + OW_RISE_LOOP_CYCLES) + OW_CYCLES_PER_US - 1) / OW_CYCLES_PER_US;
+    timing->rise_us = worst;
+
+    timing->recovery_us = 2 * worst + 1;
+    if (timing->recovery_us < OW_RECOVERY_MIN)
+        timing->recovery_us = OW_RECOVERY_MIN;
+    if (timing->recovery_us > OW_RECOVERY_MAX)
+        timing->recovery_us = OW_RECOVERY_MAX;
+
+    timing->sample_us = OW_RELEASE_TIME + 2 * worst + 1;
+    if (timing->sample_us < OW_SAMPLE_MIN)
+        timing->sample_us = OW_SAMPLE_MIN;
+    if (timing->sample_us > OW_SAMPLE_MAX)
+        timing->sample_us = OW_SAMPLE_MAX;
+
+    timing->byte_us = OW_BYTE_TIME(timing->recovery_us);
+
+    _g_timing = *timing;
+    return true;
+}
+
+bool owbitbang_bus_reset(bool *presense_detect)
+{
+    bool ret = false;
+    uint8_t i;
 
     OW_OUT_LOW();
     OW_DIR_OUT();             /* Pull OW-Pin low for 480us */
     _delay_us(240);
     _delay_us(240);
 
-    intsave = (SREG & _BV(SREG_I)) == _BV(SREG_I);
-    g_irq_disable();
-
     OW_DIR_IN();
     OW_OUT_HIGH();
-    _delay_us(64);
-    ret = !(OW_GET_IN());
 
-    if (intsave)
-        g_irq_enable();
+    /*
+     * Presence starts 15-60us after release and lasts at least 60us,
+     * so polling for it with interrupts enabled can only miss it if
+     * an ISR runs for longer than that.
+     */
+    _delay_us(OW_PRESENCE_SETTLE);
+
+    for (i = 0; i < OW_PRESENCE_POLLS; i++)
+    {
+        if (!OW_GET_IN())
+            ret = true;
+
+        _delay_us(OW_PRESENCE_POLL_US);
+    }
 
     /*
      * After a delay the clients should release the line
      * and input-pin gets back to high by pull-up-resistor.
      */
     _delay_us(240);
-    _delay_us(240 - 64);     /* Was 480-66 */
     if (OW_GET_IN() == 0)
         ret = false;          /* Short circuit, expected low but got high */
 
@@ -86,16 +210,8 @@ bool owbitbang_bus_reset(bool *presense_detect)
     return ret;
 }
 
-/*
- * HOW TO CALIBRATE:
- *
- * Place a GPIO pulse at the line mentioned below
- * Adjust OW_CONF_DELAYOFFSET until the delta between
- * the first pulse and the calibration pulse is 60uS.
- *
- * Nothing else is needed.
- */
-static uint8_t owbitbang_bit_xch(uint8_t b)
+#ifndef _OW_BITBANG_ASM_
+static uint8_t owbitbang_slot_prefix(uint8_t b)
 {
     uint8_t intsave;
 
@@ -105,7 +221,7 @@ static uint8_t owbitbang_bit_xch(uint8_t b)
     OW_OUT_LOW();
     OW_DIR_OUT();      /* Drive bus low */
 
-    _delay_us(2);     /* T_INT > 1usec accoding to timing-diagramm */
+    _delay_us(OW_RELEASE_TIME);     /* T_INT > 1usec accoding to timing-diagramm */
     if (b)
     {
         OW_DIR_IN();   /* To write "1" release bus, resistor pulls high */
@@ -118,24 +234,52 @@ static uint8_t owbitbang_bit_xch(uint8_t b)
      * the start of the slot."
      */
 
-    _delay_us(15-2+OW_CONF_DELAYOFFSET);
+    owbitbang_delay_us(_g_timing.sample_us - OW_RELEASE_TIME + OW_CONF_DELAYOFFSET);
 
     if (OW_GET_IN() == 0)
     {
         b = 0;  /* Sample at end of read-timeslot */
     }
 
-    _delay_us(60-15-2+OW_CONF_DELAYOFFSET);
+    if (intsave)
+        g_irq_enable();
+
+    return b;
+}
+#endif /* _OW_BITBANG_ASM_ */
+
+/*
+ * HOW TO CALIBRATE:
+ *
+ * Place a GPIO pulse at the line mentioned below
+ * Adjust OW_CONF_DELAYOFFSET until the delta between
+ * the first pulse and the calibration pulse is 60uS.
+ *
+ * Nothing else is needed.
+ *
+ * Only the start of the slot, up to the sample, is timing critical.
+ * The rest runs with interrupts enabled: an ISR can stretch a write 0
+ * (fine up to 120us, so ISRs must stay under 60us) or the recovery
+ * (no upper limit).
+ *
+ * Worst case interrupt latency added by the bus, from instruction and
+ * delay counts at 16MHz:
+ *
+ *   Before: ~60us per slot (2+13+43us plus overhead), 64us per reset
+ *   After:  ~16us per slot in C, 14us in ow_bitbang_asm.S, none per reset
+ */
+static uint8_t owbitbang_bit_xch(uint8_t b)
+{
+    b = owbitbang_slot_prefix(b);
+
+    owbitbang_delay_us(OW_SLOT_TIME - _g_timing.sample_us + OW_CONF_DELAYOFFSET);
 
     /* CALIBRATION PULSE GOES HERE */
     
     OW_OUT_HIGH();
     OW_DIR_IN();
 
-    if (intsave)
-        g_irq_enable();
-
-    _delay_us(OW_RECOVERY_TIME); /* May be increased for longer wires */
+    owbitbang_delay_us(_g_timing.recovery_us); /* Set by owbitbang_calibrate() */
 
     return b;
 }
@@ -241,9 +385,12 @@ bool owbitbang_select(const uint8_t *id)
     uint8_t i;
 
     if (!owbitbang_bus_reset(&presense) || !presense)
+    {
+        onewire_error(OW_ERR_PRESENCE);
         return false;
+    }
 
-    if (id)
+    if (id && !onewire_single_drop())
     {
         owbitbang_byte_xch(OW_MATCH_ROM); /* To a single device */
         i = OW_ROMCODE_SIZE;
@@ -269,4 +416,92 @@ bool owbitbang_write(const uint8_t *data, uint8_t len)
     return true;
 }
 
+/* Writes a byte, folding each bit into a CRC16 between slots */
+static uint16_t owbitbang_write_crc(uint8_t b, uint16_t crc)
+{
+    uint8_t i = 8;
+
+    do
+    {
+        owbitbang_bit_xch(b & 1);
+
+        if ((crc ^ b) & 1)
+            crc = (crc >> 1) ^ CRC16_ARC_POLY;
+        else
+            crc >>= 1;
+
+        b >>= 1;
+    } while (--i);
+
+    return crc;
+}
+
+/*
+ * Writes each segment in turn as one stream. With crc, the inverted
+ * CRC16 of everything written follows, low byte first.
+ */
+bool owbitbang_writev(const onewire_seg_t *seg, uint8_t nseg, bool crc)
+{
+    uint16_t sum = CRC16_ARC_INIT;
+    const uint8_t *data;
+    uint8_t len;
+
+    while (nseg--)
+    {
+        data = seg->data;
+        len = seg->len;
+        seg++;
+
+        while (len--)
+            sum = owbitbang_write_crc(*data++, sum);
+    }
+
+    if (crc)
+    {
+        sum = ~sum;
+        owbitbang_byte_xch((uint8_t)sum);
+        owbitbang_byte_xch((uint8_t)(sum >> 8));
+    }
+
+    return true;
+}
+
+/*
+ * As owbitbang_write(), but drives the line high straight from the end
+ * of the last slot, instead of releasing it, to power parasite devices.
+ * tSPON is 10us max so there's no recovery delay. Ends with owbitbang_pullup_off().
+ */
+bool owbitbang_write_pullup(const uint8_t *data, uint8_t len)
+{
+    uint8_t b;
+    uint8_t i;
+
+    if (!len)
+        return false;
+
+    owbitbang_write(data, len - 1);
+
+    b = data[len - 1];
+
+    for (i = 0; i < 7; i++)
+    {
+        owbitbang_bit_xch(b & 1);
+        b >>= 1;
+    }
+
+    owbitbang_slot_prefix(b & 1);
+    owbitbang_delay_us(OW_SLOT_TIME - _g_timing.sample_us + OW_CONF_DELAYOFFSET);
+
+    OW_OUT_HIGH();
+    OW_DIR_OUT();
+
+    return true;
+}
+
+bool owbitbang_pullup_off(void)
+{
+    OW_DIR_IN();    /* Leaves the internal pull-up on, as after any slot */
+    return true;
+}
+
 #endif /* _OW_BITBANG_ */
@@ -25,12 +25,16 @@
 #include <stdbool.h>
 
 bool owbitbang_init(void);
+bool owbitbang_calibrate(onewire_timing_t *timing);
 bool owbitbang_bus_reset(bool *presense_detect);
 bool owbitbang_bit_io(bool *bit);
 bool owbitbang_read(uint8_t *buf, uint8_t len);
 uint8_t owbitbang_rom_search(uint8_t diff, uint8_t *id);
 bool owbitbang_select(const uint8_t *id);
 bool owbitbang_write(const uint8_t *data, uint8_t len);
+bool owbitbang_writev(const onewire_seg_t *seg, uint8_t nseg, bool crc);
+bool owbitbang_write_pullup(const uint8_t *data, uint8_t len);
+bool owbitbang_pullup_off(void);
 
 #endif /* __OW_BITBANG_H__ */
 
@@ -20,8 +20,16 @@
 #ifndef __PROJECT_H__
 #define __PROJECT_H__
 
+#ifdef _HOST_
+#define _OW_SIM_
+// The host console stands in for USART1
+#define _USART1_
+#else
 #define _USART1_
 #define _OW_BITBANG_
+// Use the cycle counted slot start in ow_bitbang_asm.S
+//#define _OW_BITBANG_ASM_
+#endif
 
 #define F_CPU      16000000
 
@@ -30,11 +38,9 @@
 #define g_irq_disable cli
 #define g_irq_enable sei
 
-#define MAX_SENSORS             8
-
 #define UART1_BAUD              9600
 
-#define TIMEOUT_TICK_PER_SECOND  (100)
+#define TIMEOUT_TICK_PER_SECOND  (1000)
 #define TIMEOUT_MS_PER_TICK      (1000 / TIMEOUT_TICK_PER_SECOND)
 
 #define console_busy         usart1_busy
@@ -42,5 +48,6 @@
 #define console_data_ready   usart1_data_ready
 #define console_get          usart1_get
 #define console_clear_oerr   usart1_clear_oerr
+#define console_kick         usart1_kick
 
 #endif /* __PROJECT_H__ */
\ No newline at end of file
@@ -0,0 +1,362 @@
+/*
+ *   File:   report.c
+ *   Author: Matt
+ *
+ *   Readings are queued as they're taken and formatted a line at a time
+ *   from the main loop, whenever the console has finished the last one.
+ *   The transmit interrupt just copies the line out when it has nothing
+ *   else to send, so the bus never waits on the console. What the queue
+ *   can't hold goes with a later reading.
+ *
+ *   Only values which moved beyond their type's deadband are sent, plus
+ *   a keepalive per heartbeat. What was last sent is kept per device in
+ *   the registry, in 16 bits.
+ *
+ *   Created on 19 October 2026, 22:10
+ *
+ *   This is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *   This software is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *   You should have received a copy of the GNU General Public License
+ *   along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "project.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+
+#include "report.h"
+#include "sensors.h"
+#include "drivers.h"
+#include "fixedpoint.h"
+#include "timer.h"
+#include "usart.h"
+#include "util.h"
+
+/* Never a scaled value. Marks a device whose error found the queue full */
+#define REPORT_ERROR_OWED   INT16_MIN
+
+static uint8_t report_format(const report_sample_t *sample, char *buf);
+static void report_tick(uint32_t now);
+static bool report_wanted(uint8_t idx, uint8_t type, uint8_t status, int16_t value, bool *heartbeat);
+static bool report_queue(uint8_t idx, uint8_t type, uint8_t status, int32_t value, uint32_t stamp);
+
+static report_sample_t _g_report_queue[REPORT_SAMPLES];
+static uint8_t _g_report_head;                  /* Oldest sample not yet formatted */
+static uint8_t _g_report_queued;
+
+/* The transmit interrupt owns the line while its length is non-zero */
+static char _g_report_line[REPORT_LINE_MAX];
+static volatile uint8_t _g_report_len;
+static uint8_t _g_report_pos;                   /* Only touched by the transmit interrupt */
+
+/* Deadbands in report units, per DEV_xxx. Temperatures: 0.2C, or 1C a minute */
+static uint8_t _g_report_band[REPORT_TYPES] = { [DEV_DS18B20] = 2, [DEV_MPC9808] = 2 };
+static uint8_t _g_report_rate[REPORT_TYPES] = { [DEV_DS18B20] = 10, [DEV_MPC9808] = 10 };
+
+/* Report units are the driver's, shifted down to fit 16 bits. Decilux are kept in 6.4 lux steps */
+static const uint8_t _g_report_shift[REPORT_TYPES] PROGMEM = { [DEV_VEML7700] = 6 };
+
+static uint32_t _g_report_tick_start;
+static uint16_t _g_report_tick_ms = (REPORT_HEARTBEAT_S * 1000UL) / SENSOR_REPORT_AGE_MAX;
+static report_stats_t _g_report_stats;
+
+/* Band and rate in the driver's unit. A rate of 0 leaves only the band */
+void report_set_deadband(uint8_t type, uint16_t band, uint16_t rate_per_min)
+{
+    uint8_t shift;
+
+    if (type >= REPORT_TYPES)
+        return;
+
+    shift = pgm_read_byte(&_g_report_shift[type]);
+    band >>= shift;
+    rate_per_min >>= shift;
+
+    _g_report_band[type] = band > 0xFF ? 0xFF : band;
+    _g_report_rate[type] = rate_per_min > 0xFF ? 0xFF : rate_per_min;
+}
+
+/* Up to 393 seconds, the most the ticks can count */
+void report_set_heartbeat(uint16_t seconds)
+{
+    uint32_t tick_ms = (uint32_t)seconds * 1000 / SENSOR_REPORT_AGE_MAX;
+
+    _g_report_tick_ms = tick_ms > 0xFFFF ? 0xFFFF : (tick_ms ? tick_ms : 1);
+}
+
+/*
+ * For devices which watch for change themselves: whether to read one
+ * which says it hasn't changed, because its keepalive is due.
+ */
+bool report_heartbeat(uint8_t idx)
+{
+    uint8_t age;
+
+    report_tick(timer_millis());
+    sensors_reported(idx, &age);
+
+    return age >= SENSOR_REPORT_AGE_MAX;
+}
+
+static void report_tick(uint32_t now)
+{
+    uint8_t n;
+
+    for (n = 0; n < SENSOR_REPORT_AGE_MAX && now - _g_report_tick_start >= _g_report_tick_ms; n++)
+    {
+        _g_report_tick_start += _g_report_tick_ms;
+        sensors_age_reports();
+    }
+
+    // Every age has saturated, so there's nothing to catch up
+    if (now - _g_report_tick_start >= _g_report_tick_ms)
+        _g_report_tick_start = now;
+}
+
+static int16_t report_scale(uint8_t type, int32_t value)
+{
+    value >>= pgm_read_byte(&_g_report_shift[type]);
+
+    if (value > INT16_MAX)
+        return INT16_MAX;
+    if (value < -INT16_MAX)
+        return -INT16_MAX;
+
+    return (int16_t)value;
+}
+
+/*
+ * The rate test is |delta| / elapsed > rate, with elapsed taken as the
+ * end of the current tick, so the multiply can't overflow and nothing
+ * needs dividing. Within the first tick that would judge a change over
+ * the whole tick however soon it came, and the band alone applies.
+ */
+static bool report_wanted(uint8_t idx, uint8_t type, uint8_t status, int16_t value, bool *heartbeat)
+{
+    uint8_t age;
+    int16_t last = sensors_reported(idx, &age);
+    uint16_t delta;
+
+    *heartbeat = false;
+
+    if (age == SENSOR_REPORT_NONE)
+        return true;
+
+    if (status == REPORT_OK)
+    {
+        delta = value > last ? (uint16_t)(value - last) : (uint16_t)(last - value);
+
+        if (delta > _g_report_band[type])
+            return true;
+
+        if (_g_report_rate[type] && age &&
+            (uint32_t)delta * 60000UL > (uint32_t)_g_report_rate[type] * (age + 1) * _g_report_tick_ms)
+            return true;
+    }
+
+    *heartbeat = age >= SENSOR_REPORT_AGE_MAX;
+    return *heartbeat;
+}
+
+/* True if the value went, or is owed, because it moved rather than for a heartbeat */
+bool report_sample(uint8_t idx, uint8_t type, uint8_t status, int32_t value, uint32_t stamp)
+{
+    uint8_t age;
+    int16_t scaled = 0;
+    bool heartbeat = false;
+
+    if (type >= REPORT_TYPES)
+        type = DEV_UNKNOWN;
+
+    report_tick(stamp);
+
+    // Errors always go, and whatever follows one goes too. One the queue couldn't take goes first
+    if (status == REPORT_ERROR || (sensors_reported(idx, &age) == REPORT_ERROR_OWED && age == SENSOR_REPORT_NONE))
+    {
+        if (!report_queue(idx, type, REPORT_ERROR, 0, stamp))
+        {
+            sensors_set_reported(idx, REPORT_ERROR_OWED, SENSOR_REPORT_NONE);
+
+            if (status == REPORT_ERROR)
+                _g_report_stats.dropped++;
+
+            return true;
+        }
+
+        sensors_set_reported(idx, 0, SENSOR_REPORT_NONE);
+
+        if (status == REPORT_ERROR)
+            return true;
+    }
+
+    if (status == REPORT_OK)
+        scaled = report_scale(type, value);
+
+    if (!report_wanted(idx, type, status, scaled, &heartbeat))
+    {
+        _g_report_stats.suppressed++;
+        return false;
+    }
+
+    // Not marked as sent, so the next reading is judged against what was
+    if (!report_queue(idx, type, status, value, stamp))
+    {
+        _g_report_stats.dropped++;
+        return !heartbeat;
+    }
+
+    if (heartbeat)
+        _g_report_stats.heartbeats++;
+
+    sensors_set_reported(idx, scaled, 0);
+
+    return !heartbeat;
+}
+
+/* Queues a sample for the console and hands it over if it's free. False if the queue is full */
+static bool report_queue(uint8_t idx, uint8_t type, uint8_t status, int32_t value, uint32_t stamp)
+{
+    report_sample_t *sample;
+    uint8_t tail;
+
+    // Frees a slot if the console has finished the last line
+    if (_g_report_queued == REPORT_SAMPLES)
+        report_publish();
+
+    if (_g_report_queued == REPORT_SAMPLES)
+        return false;
+
+    _g_report_stats.sent++;
+
+    tail = _g_report_head + _g_report_queued++;
+    if (tail >= REPORT_SAMPLES)
+        tail -= REPORT_SAMPLES;
+
+    sample = &_g_report_queue[tail];
+    sample->idx = idx;
+    sample->type = type;
+    sample->status = status;
+    sample->stamp_ms = stamp;
+    sample->value = value;
+
+    report_publish();
+
+    return true;
+}
+
+/*
+ * Formats the oldest queued sample for the console, once it has sent
+ * the last line. Cheap when there's nothing to do, so it's called
+ * whenever the main loop is waiting.
+ */
+void report_publish(void)
+{
+    uint8_t len;
+
+    if (_g_report_len || !_g_report_queued)
+        return;
+
+    len = report_format(&_g_report_queue[_g_report_head], _g_report_line);
+
+    if (++_g_report_head == REPORT_SAMPLES)
+        _g_report_head = 0;
+    _g_report_queued--;
+    _g_report_stats.bytes += len;
+
+    // The line is complete in memory before the interrupt can see it
+    __asm__ __volatile__ ("" ::: "memory");
+    _g_report_len = len;
+
+    console_kick();
+}
+
+/*
+ * Next character to send, or -1. A line, once begun, is always finished;
+ * a new one is begun only when start is set, i.e. the console has no
+ * line of its own in progress. Called from the transmit interrupt.
+ */
+int16_t report_tx_next(bool start)
+{
+    uint8_t len = _g_report_len;
+    char c;
+
+    if (!len || (!_g_report_pos && !start))
+        return -1;
+
+    c = _g_report_line[_g_report_pos++];
+
+    // Hand the line back for the next
+    if (_g_report_pos == len)
+    {
+        _g_report_pos = 0;
+        _g_report_len = 0;
+    }
+
+    return c;
+}
+
+void report_get_stats(report_stats_t *stats)
+{
+    *stats = _g_report_stats;
+}
+
+void report_dump_stats(void)
+{
+    report_stats_t stats;
+
+    report_get_stats(&stats);
+
+    printf("Reports: %lu sent, %lu of them heartbeats, %lu suppressed, %lu dropped, %lu bytes\r\n",
+        stats.sent, stats.heartbeats, stats.suppressed, stats.dropped, stats.bytes);
+}
+
+static uint8_t report_format(const report_sample_t *sample, char *buf)
+{
+    driver_t drv;
+    uint8_t len;
+
+    driver_get(sample->type, &drv);
+
+    if (sample->status == REPORT_ERROR)
+    {
+        strcpy_P(buf, PSTR("Error reading from "));
+        len = sizeof("Error reading from ") - 1;
+        len += driver_format_name(&drv, false, buf + len);
+        buf[len++] = ' ';
+        len += fixedpoint_format_u32(sample->idx, buf + len);
+    }
+    else
+    {
+        len = driver_format_name(&drv, true, buf);
+        strcpy_P(buf + len, PSTR(" @ Index "));
+        len += sizeof(" @ Index ") - 1;
+        len += fixedpoint_format_u32(sample->idx, buf + len);
+
+        if (sample->status == REPORT_OK)
+        {
+            buf[len++] = ':';
+            buf[len++] = ' ';
+            len += drv.format(sample->value, buf + len);
+            strcpy_P(buf + len, PSTR(" @ "));
+            len += sizeof(" @ ") - 1;
+            len += fixedpoint_format_u32(sample->stamp_ms, buf + len);
+            strcpy_P(buf + len, PSTR(" ms"));
+            len += sizeof(" ms") - 1;
+        }
+    }
+
+    buf[len++] = '\r';
+    buf[len++] = '\n';
+
+    return len;
+}
@@ -0,0 +1,81 @@
+/*
+ *   File:   report.h
+ *   Author: Matt
+ *
+ *   Created on 19 October 2026, 22:10
+ *
+ *   This is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *   This software is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *   You should have received a copy of the GNU General Public License
+ *   along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __REPORT_H__
+#define __REPORT_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Outcome of a read, as reported */
+#define REPORT_OK               0
+#define REPORT_ERROR            1
+#define REPORT_NO_VALUE         2   /* The driver has no read, the device is just listed */
+
+/*
+ * Samples waiting for the console. At 9600 baud a line takes 60ms or so,
+ * so a busy cycle can't all go. A value which finds the queue full is
+ * dropped without being marked as sent, so it goes with a later reading.
+ */
+#define REPORT_SAMPLES          7
+#define REPORT_LINE_MAX         80
+
+/*
+ * A value is sent when it has moved more than the type's band since it
+ * was last sent, or more than its rate per minute allows for the time
+ * since, and otherwise at least once per heartbeat. Bands and rates are
+ * in the driver's unit. The heartbeat is kept in SENSOR_REPORT_AGE_MAX
+ * ticks, so rates are judged to within a tick, and only from the second.
+ */
+#define REPORT_HEARTBEAT_S      60
+#define REPORT_TYPES            4       /* DEV_xxx */
+
+/* Must match report_sample_t, the queue and line, and the deadband state in report.c */
+#define REPORT_SAMPLE_BYTES     10
+#define REPORT_STATE_BYTES      (REPORT_TYPES * 2 + 26)
+#define REPORT_RAM_BYTES        (2 + REPORT_SAMPLES * REPORT_SAMPLE_BYTES + REPORT_LINE_MAX + 2 + REPORT_STATE_BYTES)
+
+typedef struct
+{
+    uint8_t idx;
+    uint8_t type : 3;           /* DEV_xxx, for the driver's name and format */
+    uint8_t status : 2;         /* REPORT_xxx */
+    uint8_t spare : 3;
+    uint32_t stamp_ms;          /* Acquisition time */
+    int32_t value;
+} report_sample_t;
+
+typedef struct
+{
+    uint32_t sent;              /* Samples sent, errors included */
+    uint32_t heartbeats;        /* Of which only because the heartbeat was due */
+    uint32_t suppressed;        /* Readings taken but not sent */
+    uint32_t dropped;           /* Due to be sent, but the queue was full */
+    uint32_t bytes;             /* Sent to the console */
+} report_stats_t;
+
+void report_set_deadband(uint8_t type, uint16_t band, uint16_t rate_per_min);
+void report_set_heartbeat(uint16_t seconds);
+bool report_heartbeat(uint8_t idx);
+bool report_sample(uint8_t idx, uint8_t type, uint8_t status, int32_t value, uint32_t stamp);
+void report_publish(void);
+int16_t report_tx_next(bool start);
+void report_get_stats(report_stats_t *stats);
+void report_dump_stats(void);
+
+#endif /* __REPORT_H__ */
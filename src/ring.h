@@ -0,0 +1,165 @@
+/*
+ *   File:   ring.h
+ *   Author: Matt
+ *
+ *   Single producer, single consumer ring buffers, generated per element
+ *   type and size:
+ *
+ *      RING_DECLARE(name, type, size)  in a header, or at the top of a .c
+ *      RING_DEFINE(name, type, size)   in exactly one .c
+ *
+ *   give name_t and name_init(), name_push(), name_pop(), name_push_n(),
+ *   name_pop_n(), name_count() and name_space(). size is a power of two,
+ *   up to 128, and every slot is usable.
+ *
+ *   One side, e.g. an ISR, may only push and the other only pop. Each
+ *   side writes just its own index, a single byte, so reads of it are
+ *   atomic on the AVR and no interrupts need disabling. Elements are
+ *   copied in before the head moves and out before the tail moves, with
+ *   a compiler barrier in between, so neither side sees a slot the other
+ *   hasn't finished with. Bulk calls copy at most two contiguous spans.
+ *
+ *   Created on 19 October 2026, 23:20
+ *
+ *   This is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *   This software is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *   You should have received a copy of the GNU General Public License
+ *   along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RING_H__
+#define __RING_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/* Stops the compiler moving element copies past index updates */
+#define RING_BARRIER() __asm__ __volatile__ ("" ::: "memory")
+
+/* Where the other side may run in the middle of a call. The host bench runs a simulated ISR here */
+#ifndef RING_PREEMPT
+#define RING_PREEMPT()
+#endif
+
+#define RING_CHECK_SIZE(size) \
+    typedef char ring_size_##size##_must_be_a_power_of_two_up_to_128[(((size) & ((size) - 1)) == 0 && (size) <= 128) ? 1 : -1]
+
+/* Head and tail run freely, wrapping at 256, so head - tail is the count even when full */
+#define RING_DECLARE(name, type, size) \
+    typedef struct \
+    { \
+        type buf[size]; \
+        volatile uint8_t head; \
+        volatile uint8_t tail; \
+    } name##_t; \
+    void name##_init(name##_t *r); \
+    bool name##_push(name##_t *r, const type *item); \
+    bool name##_pop(name##_t *r, type *item); \
+    uint8_t name##_push_n(name##_t *r, const type *items, uint8_t n); \
+    uint8_t name##_pop_n(name##_t *r, type *items, uint8_t n); \
+    uint8_t name##_count(const name##_t *r); \
+    uint8_t name##_space(const name##_t *r)
+
+#define RING_DEFINE(name, type, size) \
+    RING_CHECK_SIZE(size); \
+    \
+    void name##_init(name##_t *r) \
+    { \
+        r->head = 0; \
+        r->tail = 0; \
+    } \
+    \
+    uint8_t name##_count(const name##_t *r) \
+    { \
+        return (uint8_t)(r->head - r->tail); \
+    } \
+    \
+    uint8_t name##_space(const name##_t *r) \
+    { \
+        return (uint8_t)((size) - (uint8_t)(r->head - r->tail)); \
+    } \
+    \
+    bool name##_push(name##_t *r, const type *item) \
+    { \
+        uint8_t head = r->head; \
+        \
+        if ((uint8_t)(head - r->tail) == (size)) \
+            return false; \
+        \
+        RING_PREEMPT(); \
+        r->buf[head & ((size) - 1)] = *item; \
+        RING_BARRIER(); \
+        RING_PREEMPT(); \
+        r->head = head + 1; \
+        return true; \
+    } \
+    \
+    bool name##_pop(name##_t *r, type *item) \
+    { \
+        uint8_t tail = r->tail; \
+        \
+        if (r->head == tail) \
+            return false; \
+        \
+        RING_PREEMPT(); \
+        *item = r->buf[tail & ((size) - 1)]; \
+        RING_BARRIER(); \
+        RING_PREEMPT(); \
+        r->tail = tail + 1; \
+        return true; \
+    } \
+    \
+    uint8_t name##_push_n(name##_t *r, const type *items, uint8_t n) \
+    { \
+        uint8_t head = r->head; \
+        uint8_t space = (size) - (uint8_t)(head - r->tail); \
+        uint8_t at = head & ((size) - 1); \
+        uint8_t first; \
+        \
+        if (n > space) \
+            n = space; \
+        \
+        first = (size) - at; \
+        if (first > n) \
+            first = n; \
+        \
+        RING_PREEMPT(); \
+        memcpy(&r->buf[at], items, first * sizeof(type)); \
+        memcpy(&r->buf[0], items + first, (n - first) * sizeof(type)); \
+        RING_BARRIER(); \
+        RING_PREEMPT(); \
+        r->head = head + n; \
+        return n; \
+    } \
+    \
+    uint8_t name##_pop_n(name##_t *r, type *items, uint8_t n) \
+    { \
+        uint8_t tail = r->tail; \
+        uint8_t count = (uint8_t)(r->head - tail); \
+        uint8_t at = tail & ((size) - 1); \
+        uint8_t first; \
+        \
+        if (n > count) \
+            n = count; \
+        \
+        first = (size) - at; \
+        if (first > n) \
+            first = n; \
+        \
+        RING_PREEMPT(); \
+        memcpy(items, &r->buf[at], first * sizeof(type)); \
+        memcpy(items + first, &r->buf[0], (n - first) * sizeof(type)); \
+        RING_BARRIER(); \
+        RING_PREEMPT(); \
+        r->tail = tail + n; \
+        return n; \
+    }
+
+#endif /* __RING_H__ */
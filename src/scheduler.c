@@ -0,0 +1,681 @@
+/*
+ *   File:   scheduler.c
+ *   Author: Matt
+ *
+ *   Created on 19 October 2026, 16:20
+ * 
+ *   This is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *   This software is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *   You should have received a copy of the GNU General Public License
+ *   along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "project.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/pgmspace.h>
+
+#include "onewire.h"
+#include "ds2482.h"
+#include "ow_bitbang.h"
+#include "sensors.h"
+#include "drivers.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "util.h"
+#include "report.h"
+#include "ds18b20.h"
+
+static bool read_sensor(uint8_t i, const uint8_t *id, const driver_t *drv, bool *moved);
+static void convert_broadcast(void);
+static void convert_parasite(void);
+static void trigger_note(uint32_t began);
+static void read_power(uint8_t i);
+static void plan(void);
+static bool sweep_pass(void);
+static void start_pending(bool native);
+static void cost_note(uint16_t *cost, uint32_t us);
+static void adapt(uint8_t i, bool moved);
+
+#define SCHEDULER_SWEEP_MS      10000   /* From the end of one background sweep to the start of the next */
+#define SCHEDULER_SLICE_MS      100     /* Searching per cycle until the first sweep completes */
+#define SCHEDULER_PERIOD_MS     1000    /* From the start of one cycle to the next, unless it overruns */
+#define SCHEDULER_BUS_CAP       50      /* Percent of a period the bus may spend on starts, reads and pull-up holds */
+#define SCHEDULER_HOLD_US       ((DS18B20_TCONV_12BIT + 1) * 1000UL)   /* A conversion under the strong pull-up */
+
+/* Polling intervals as 1 << n cycles. The shortest is kept in the low nibble, the longest in the high */
+#define SCHEDULER_BOUNDS(shortest, longest) ((shortest) | ((longest) << 4))
+
+static uint8_t _g_parasite_count;
+static bool _g_broadcast;          /* One Skip ROM Convert T for every DS18B20 */
+static bool _g_planned;
+
+/* Background search, to find devices joining and leaving the bus */
+static bool _g_sweeping;
+static uint32_t _g_last_sweep;
+
+/*
+ * Each device is read less often while its value holds, down to the
+ * longest interval for its type, and more often again once it moves.
+ * The longest times the period should stay inside the report heartbeat.
+ */
+static uint8_t _g_poll_bounds[DEV_NUM_TYPES] =
+{
+    [DEV_UNKNOWN]  = SCHEDULER_BOUNDS(SENSOR_INTERVAL_MAX, SENSOR_INTERVAL_MAX),
+    [DEV_DS18B20]  = SCHEDULER_BOUNDS(0, 4),
+    [DEV_VEML7700] = SCHEDULER_BOUNDS(0, 3),
+    [DEV_MPC9808]  = SCHEDULER_BOUNDS(0, 4),
+};
+
+/* Bus time per start and per read, in us, averaged by type, to keep each cycle under the cap */
+static uint16_t _g_start_cost[DEV_NUM_TYPES];
+static uint16_t _g_read_cost[DEV_NUM_TYPES];
+static uint8_t _g_bus_cap = SCHEDULER_BUS_CAP;
+static uint8_t _g_poll_next;       /* First device offered the bus next cycle */
+static uint32_t _g_cycle_start;
+
+/* Convert T timing for the current cycle, in us */
+static uint8_t _g_trigger_count;
+static uint32_t _g_trigger_first;
+static uint32_t _g_trigger_last;
+static uint32_t _g_trigger_cost;
+
+/* For scheduler_dump_stats(). Trigger figures are from the last cycle which converted any DS18B20s */
+static uint32_t _g_cycles;
+static uint32_t _g_deferred;       /* Reads the bus cap put off to a later cycle */
+static uint16_t _g_cycle_ms;
+static uint16_t _g_cycle_ms_max;
+static uint8_t _g_triggered;
+static uint32_t _g_skew_us;
+static uint32_t _g_skew_us_max;
+static uint32_t _g_triggered_cost;
+
+/*
+ * Work out how DS18B20s get their Convert T. A Skip ROM broadcast starts
+ * them all at the same instant for the cost of one selection, but only
+ * when the segment has nothing else on it that Skip ROM would upset.
+ * Otherwise each gets a Match ROM, back to back so skew is as small as
+ * the bus allows.
+ *
+ * Parasite parts draw their conversion current through the strong
+ * pull-up, so nothing else may use the bus until they're done. They're
+ * broadcast when the supply can carry all of them at once, otherwise
+ * converted one at a time.
+ */
+void scheduler_init(void)
+{
+    uint8_t i;
+
+    _g_planned = false;
+    _g_sweeping = false;
+    _g_last_sweep = timer_millis();
+    _g_poll_next = 0;
+
+    /* The first cycle doesn't wait */
+    _g_cycle_start = _g_last_sweep - SCHEDULER_PERIOD_MS;
+
+    /* Whatever sensors_enumerate() found. Otherwise the background search finds it all */
+    for (i = 0; i < sensors_count(); i++)
+        read_power(i);
+
+    if (sensors_count())
+        plan();
+}
+
+/* As 1 << n cycles, each up to SENSOR_INTERVAL_MAX. A VEML7700 can't tell when it's due over longer than its stamp covers */
+void scheduler_set_intervals(uint8_t type, uint8_t shortest, uint8_t longest)
+{
+    if (type >= DEV_NUM_TYPES)
+        return;
+
+    if (longest > SENSOR_INTERVAL_MAX)
+        longest = SENSOR_INTERVAL_MAX;
+
+    while (type == DEV_VEML7700 && longest && ((uint32_t)SCHEDULER_PERIOD_MS << longest) > DRIVER_VEML7700_POLL_MAX_MS)
+        longest--;
+    if (shortest > longest)
+        shortest = longest;
+
+    _g_poll_bounds[type] = SCHEDULER_BOUNDS(shortest, longest);
+}
+
+/* Percent of each cycle period. 0 for no cap */
+void scheduler_set_bus_cap(uint8_t percent)
+{
+    _g_bus_cap = percent;
+}
+
+static void read_power(uint8_t i)
+{
+    uint8_t id[OW_ROMCODE_SIZE];
+    bool parasite = false;
+
+    if (sensors_family(i) != SENSOR_FAMILY_DS18B20)
+        return;
+
+    sensors_get_id(i, id);
+
+    if (!ds18b20_read_power(id, &parasite))
+        printf("Error reading power supply of sensor %d\r\n", i);
+
+    sensors_set_parasite(i, parasite);
+}
+
+/* Over the devices present now. Reported when it changes */
+static void plan(void)
+{
+    uint8_t i;
+    uint8_t parasite_count = 0;
+    uint8_t native = 0;
+    bool bridged = false;
+    bool broadcast;
+
+    for (i = 0; i < sensors_count(); i++)
+    {
+        if (!sensors_present(i))
+            continue;
+
+        if (sensors_family(i) != SENSOR_FAMILY_DS18B20)
+            bridged = true;
+        else if (native++, sensors_parasite(i))
+            parasite_count++;
+    }
+
+    broadcast = !bridged && (uint16_t)parasite_count * DS18B20_CONV_MA_X2 <= OW_SPU_BUDGET_MA * 2;
+
+    if (_g_planned && broadcast == _g_broadcast && parasite_count == _g_parasite_count)
+        return;
+
+    _g_broadcast = broadcast;
+    _g_parasite_count = parasite_count;
+
+    /* Nothing to say until there's a DS18B20 */
+    if (!native)
+        return;
+
+    _g_planned = true;
+
+    if (!_g_parasite_count)
+        printf("DS18B20s externally powered, converting %s\r\n", _g_broadcast ? "by broadcast" : "by Match ROM");
+    else
+        printf("%u parasite powered DS18B20s, converting %s\r\n", _g_parasite_count, _g_broadcast ? "by broadcast" : "one at a time");
+}
+
+static void print_found(void)
+{
+    uint8_t i;
+    uint8_t counts[SENSOR_NUM_FAMILIES] = { 0 };
+
+    for (i = 0; i < sensors_count(); i++)
+    {
+        if (sensors_present(i))
+            counts[sensors_family(i)]++;
+    }
+
+    printf("Found %u native and %u bridged sensors of %u total\r\n", counts[SENSOR_FAMILY_DS18B20], counts[SENSOR_FAMILY_DS28E17], SENSOR_MAX);
+
+    if (sensors_dropped())
+        printf("Warning: %u sensors did not fit in the sensor table\r\n", sensors_dropped());
+}
+
+/*
+ * One search pass, bringing up anything which joined. The first sweep
+ * runs back to back, later ones SCHEDULER_SWEEP_MS apart. False if no
+ * pass was due.
+ */
+static bool sweep_pass(void)
+{
+    uint8_t joined;
+    uint8_t result;
+    driver_t drv;
+
+    if (!_g_sweeping)
+    {
+        if (sensors_sweeps() && !timeout_expired_ms(_g_last_sweep, SCHEDULER_SWEEP_MS))
+            return false;
+
+        _g_sweeping = true;
+    }
+
+    onewire_clear_error();
+    result = sensors_sweep_step(&joined);
+
+    if (result == SENSOR_SWEEP_FAILED)
+        printf("Search interrupted, starting again\r\n");
+
+    if (joined != SENSOR_NONE)
+    {
+        drivers_probe_device(joined);
+        read_power(joined);
+
+        driver_get(sensors_type(joined), &drv);
+        driver_print_name(&drv, false);
+        printf(" joined @ Index %d\r\n", joined);
+    }
+
+    if (result == SENSOR_SWEEP_DONE)
+    {
+        _g_sweeping = false;
+        _g_last_sweep = timer_millis();
+
+        if (sensors_sweeps() == 1)
+            print_found();
+    }
+
+    if (result == SENSOR_SWEEP_DONE || joined != SENSOR_NONE)
+        plan();
+
+    return true;
+}
+
+/*
+ * One acquisition cycle over every device in the registry which is due.
+ * Devices are offered the bus in turn from where the last cycle's cap
+ * cut in, and any the cap leaves out wait for the next.
+ */
+void scheduler_cycle(void)
+{
+    uint8_t i;
+    uint8_t n;
+    uint8_t id[OW_ROMCODE_SIZE];
+    driver_t drv;
+    uint32_t cycle_start;
+    uint32_t conv_start;
+    uint32_t began;
+    uint32_t now;
+    uint32_t budget = (uint32_t)SCHEDULER_PERIOD_MS * 10 * _g_bus_cap;
+    uint32_t spent = 0;
+    uint32_t cost;
+    uint8_t type;
+    uint8_t deferred = 0;
+    bool hold;
+    bool held = false;
+    uint8_t outstanding;
+    uint8_t ready;
+    uint32_t slice_start;
+    bool swept = false;
+    bool moved;
+    bool ok;
+
+    /* Intervals are counted in cycles, so cycles keep to the period */
+    while (!timeout_expired_ms(_g_cycle_start, SCHEDULER_PERIOD_MS))
+        report_publish();
+
+    cycle_start = _g_cycle_start = timer_millis();
+
+    _g_trigger_count = 0;
+    _g_trigger_cost = 0;
+
+    if (_g_poll_next >= sensors_count())
+        _g_poll_next = 0;
+
+    for (n = 0, i = _g_poll_next; n < sensors_count(); n++, i = (i + 1 < sensors_count()) ? i + 1 : 0)
+    {
+        sensors_set_pending(i, false);
+
+        if (!sensors_present(i))
+            continue;
+
+        // Failing devices back off, and eventually sit in quarantine. Steady ones are read less often
+        if (!sensors_due(i))
+            continue;
+
+        type = sensors_type(i);
+        cost = (uint32_t)_g_start_cost[type] + _g_read_cost[type];
+
+        // The strong pull-up keeps the bus for a whole conversion: once for a broadcast, otherwise per parasite part
+        hold = _g_parasite_count && sensors_family(i) == SENSOR_FAMILY_DS18B20 &&
+            (_g_broadcast ? !held : sensors_parasite(i));
+
+        if (hold)
+            cost += SCHEDULER_HOLD_US;
+
+        if (_g_bus_cap && spent && spent + cost > budget)
+        {
+            if (!deferred++)
+                _g_poll_next = i;
+            continue;
+        }
+
+        spent += cost;
+        held |= hold;
+
+        sensors_set_pending(i, true);
+    }
+
+    /* Match ROM Convert Ts back to back, so the bridges' slower starts don't widen the skew */
+    start_pending(true);
+    start_pending(false);
+
+    _g_deferred += deferred;
+
+    if (_g_broadcast && !_g_parasite_count)
+        convert_broadcast();
+
+    /* Every conversion not under the strong pull-up is under way now */
+    conv_start = timer_millis();
+
+    /* Parasite conversions block for at least one conversion time, so the above finish meanwhile */
+    if (_g_broadcast && _g_parasite_count)
+        convert_broadcast();
+    else if (!_g_broadcast && _g_parasite_count)
+        convert_parasite();
+
+    if (_g_trigger_count)
+    {
+        _g_triggered = _g_trigger_count;
+        _g_skew_us = _g_trigger_last - _g_trigger_first;
+        _g_triggered_cost = _g_trigger_cost;
+
+        if (_g_skew_us > _g_skew_us_max)
+            _g_skew_us_max = _g_skew_us;
+    }
+
+    /*
+     * Devices which convert continuously are ready on the first pass,
+     * so they're read while everything else is still converting. Passes
+     * with nothing to read search the bus instead.
+     */
+    do
+    {
+        uint16_t elapsed = (uint16_t)(timer_millis() - conv_start);
+
+        outstanding = 0;
+        ready = 0;
+
+        for (i = 0; i < sensors_count(); i++)
+        {
+            if (!sensors_pending(i))
+                continue;
+
+            driver_get(sensors_type(i), &drv);
+            sensors_get_id(i, id);
+
+            if (drv.poll && !drv.poll(i, id, elapsed))
+            {
+                outstanding++;
+                continue;
+            }
+
+            onewire_clear_error();
+            began = timer_micros();
+            ok = read_sensor(i, id, &drv, &moved);
+            cost_note(&_g_read_cost[sensors_type(i)], timer_micros() - began);
+            sensors_record(i, ok);
+            sensors_set_pending(i, false);
+            ready++;
+
+            if (ok)
+                adapt(i, moved);
+        }
+
+        if (outstanding && !ready)
+        {
+            if (sweep_pass())
+                swept = true;
+            else
+                // Polls go by whole milliseconds, so there's nothing new to ask until the next
+                for (now = timer_millis(); timer_millis() == now;)
+                    report_publish();
+        }
+    } while (outstanding);
+
+    /* Whatever's still queued goes out while the next cycle waits and runs */
+    report_publish();
+
+    /* Until the bus is known, keep searching for a while. After that, a pass per cycle if none ran above */
+    slice_start = timer_millis();
+
+    if (!sensors_sweeps())
+    {
+        while (!sensors_sweeps() && !timeout_expired_ms(slice_start, SCHEDULER_SLICE_MS))
+            sweep_pass();
+    }
+    else if (!swept)
+    {
+        sweep_pass();
+    }
+
+    _g_cycles++;
+    _g_cycle_ms = (uint16_t)(timer_millis() - cycle_start);
+
+    if (_g_cycle_ms > _g_cycle_ms_max)
+        _g_cycle_ms_max = _g_cycle_ms;
+}
+
+/* Kept out of the cycle, which would otherwise wait on the console to print them */
+void scheduler_dump_stats(void)
+{
+    printf("Cycles: %lu, last %u ms, longest %u ms, %lu reads put off by the bus cap\r\n",
+        _g_cycles, _g_cycle_ms, _g_cycle_ms_max, _g_deferred);
+
+    if (_g_triggered)
+    {
+        printf("Trigger: %u DS18B20 %s, skew %lu us (worst %lu us), cost %lu us\r\n", _g_triggered,
+            _g_broadcast ? "by broadcast" : "by Match ROM", _g_skew_us, _g_skew_us_max, _g_triggered_cost);
+    }
+}
+
+/*
+ * Starts the pending devices which need it, either the DS18B20s or
+ * everything else. DS18B20s to be broadcast, or converted under the
+ * strong pull-up, are left for later.
+ */
+static void start_pending(bool native)
+{
+    uint8_t i;
+    uint8_t id[OW_ROMCODE_SIZE];
+    uint8_t type;
+    uint32_t began;
+    driver_t drv;
+
+    for (i = 0; i < sensors_count(); i++)
+    {
+        if (!sensors_pending(i) || (sensors_family(i) == SENSOR_FAMILY_DS18B20) != native)
+            continue;
+
+        if (native && (_g_broadcast || sensors_parasite(i)))
+            continue;
+
+        type = sensors_type(i);
+        driver_get(type, &drv);
+
+        if (!drv.start)
+            continue;
+
+        sensors_get_id(i, id);
+        onewire_clear_error();
+
+        // Don't broadcast 'start measure' command on a mixed bus. DS28E17's don't know what to do with it.
+        began = timer_micros();
+
+        if (!drv.start(i, id))
+        {
+            printf("Error starting measurement on sensor %d\r\n", i);
+            sensors_record(i, false);
+            sensors_set_pending(i, false);
+            continue;
+        }
+
+        cost_note(&_g_start_cost[type], timer_micros() - began);
+
+        if (native)
+            trigger_note(began);
+    }
+}
+
+/* Running average, the latest weighted a quarter. The first stands alone */
+static void cost_note(uint16_t *cost, uint32_t us)
+{
+    if (us > 0xFFFF)
+        us = 0xFFFF;
+
+    if (!*cost)
+        *cost = (uint16_t)us;
+    else
+        *cost = *cost - (*cost >> 2) + (uint16_t)(us >> 2);
+}
+
+/* After a good read: four times as often once the value moves, half as often while it holds */
+static void adapt(uint8_t i, bool moved)
+{
+    uint8_t bounds = _g_poll_bounds[sensors_type(i)];
+    uint8_t shortest = bounds & 0x0F;
+    uint8_t longest = bounds >> 4;
+    uint8_t interval = sensors_interval(i);
+
+    if (moved)
+        interval = interval > shortest + 2 ? interval - 2 : shortest;
+    else if (interval < longest)
+        interval++;
+
+    if (interval < shortest)
+        interval = shortest;
+    if (interval > longest)
+        interval = longest;
+
+    sensors_set_interval(i, interval);
+}
+
+/* Called as each Convert T completes */
+static void trigger_note(uint32_t began)
+{
+    uint32_t now = timer_micros();
+
+    if (!_g_trigger_count++)
+        _g_trigger_first = now;
+
+    _g_trigger_last = now;
+    _g_trigger_cost += now - began;
+}
+
+/* Holds the strong pull-up for a whole conversion. The extra ms covers timer granularity */
+static bool convert_wait(const uint8_t *id)
+{
+    uint32_t start;
+    uint32_t began = timer_micros();
+
+    if (!ds18b20_start_measure_powered(id))
+        return false;
+
+    trigger_note(began);
+    start = timer_millis();
+    while (!timeout_expired_ms(start, DS18B20_TCONV_12BIT + 1));
+
+    return ow_pullup_off();
+}
+
+/* Every DS18B20 on the segment, whether or not it's due this cycle */
+static void convert_broadcast(void)
+{
+    uint8_t i;
+    uint8_t pending = 0;
+    uint32_t began;
+    bool ok;
+
+    for (i = 0; i < sensors_count(); i++)
+    {
+        if (sensors_pending(i) && sensors_family(i) == SENSOR_FAMILY_DS18B20)
+            pending++;
+    }
+
+    if (!pending)
+        return;
+
+    onewire_clear_error();
+
+    if (_g_parasite_count)
+    {
+        ok = convert_wait(NULL);
+    }
+    else
+    {
+        began = timer_micros();
+        ok = ds18b20_start_measure(NULL);
+
+        if (ok)
+            trigger_note(began);
+    }
+
+    if (ok)
+    {
+        /* One Convert T reached all of them */
+        _g_trigger_count = pending;
+        return;
+    }
+
+    printf("Error starting broadcast measurement\r\n");
+
+    for (i = 0; i < sensors_count(); i++)
+    {
+        if (sensors_pending(i) && sensors_family(i) == SENSOR_FAMILY_DS18B20)
+        {
+            sensors_record(i, false);
+            sensors_set_pending(i, false);
+        }
+    }
+}
+
+static void convert_parasite(void)
+{
+    uint8_t i;
+    uint8_t id[OW_ROMCODE_SIZE];
+
+    for (i = 0; i < sensors_count(); i++)
+    {
+        if (!sensors_pending(i) || !sensors_parasite(i))
+            continue;
+
+        sensors_get_id(i, id);
+        onewire_clear_error();
+
+        if (!convert_wait(id))
+        {
+            printf("Error starting measurement on sensor %d\r\n", i);
+            sensors_record(i, false);
+            sensors_set_pending(i, false);
+        }
+    }
+}
+
+static bool read_sensor(uint8_t i, const uint8_t *id, const driver_t *drv, bool *moved)
+{
+    int32_t value;
+    bool changed = true;
+    uint32_t stamp; // acquisition time of the reading, in ms since boot
+
+    *moved = false;
+
+    if (!drv->read)
+    {
+        report_sample(i, sensors_type(i), REPORT_NO_VALUE, 0, timer_millis());
+        return true;
+    }
+
+    // Devices which haven't changed are only read for their keepalive
+    if (drv->changed && !drv->changed(i, id, &changed))
+        goto fail;
+
+    if (!changed && !report_heartbeat(i))
+        return true;
+
+    if (!drv->read(i, id, &value))
+        goto fail;
+
+    stamp = timer_millis();
+
+    *moved = report_sample(i, sensors_type(i), REPORT_OK, value, stamp);
+    return true;
+
+fail:
+    report_sample(i, sensors_type(i), REPORT_ERROR, 0, timer_millis());
+    return false;
+}
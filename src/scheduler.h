@@ -0,0 +1,30 @@
+/*
+ *   File:   scheduler.h
+ *   Author: Matt
+ *
+ *   Created on 19 October 2026, 16:20
+ * 
+ *   This is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *   This software is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *   You should have received a copy of the GNU General Public License
+ *   along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SCHEDULER_H__
+#define __SCHEDULER_H__
+
+#include <stdint.h>
+
+void scheduler_init(void);
+void scheduler_cycle(void);
+void scheduler_set_intervals(uint8_t type, uint8_t shortest, uint8_t longest);
+void scheduler_set_bus_cap(uint8_t percent);
+void scheduler_dump_stats(void);
+
+#endif /* __SCHEDULER_H__ */
@@ -0,0 +1,432 @@
+/*
+ *   File:   sensors.c
+ *   Author: Matt
+ *
+ *   Created on 19 October 2026, 11:40
+ *
+ *   This is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *   This software is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *   You should have received a copy of the GNU General Public License
+ *   along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "project.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/pgmspace.h>
+
+#include "onewire.h"
+#include "sensors.h"
+#include "ds18b20.h"
+#include "ds28e17.h"
+#include "crc8.h"
+#include "util.h"
+
+#if SENSOR_NUM_ERRORS != OW_NUM_ERRORS
+#error Sensor error counters out of step with OW_ERR_xxx
+#endif
+
+/* A healthy device's skip byte: cycles left to sit out, under its interval */
+#define SENSOR_SKIP_COUNT           0x1F
+#define SENSOR_SKIP_INTERVAL_SHIFT  5
+
+#if ((1 << SENSOR_INTERVAL_MAX) - 1) > SENSOR_SKIP_COUNT
+#error Polling interval too long for the skip count
+#endif
+
+/*
+ * Device table, stored as structure-of-arrays so that nothing is
+ * padded and each field can be walked on its own.
+ */
+static uint8_t _g_sensor_serial[SENSOR_MAX][SENSOR_SERIAL_SIZE];
+static sensor_info_t _g_sensor_info[SENSOR_MAX];
+static uint8_t _g_sensor_errors[SENSOR_MAX][SENSOR_NUM_ERRORS];
+static sensor_health_t _g_sensor_health[SENSOR_MAX];
+static uint8_t _g_sensor_skip[SENSOR_MAX];       /* Cycles to sit out. See sensors_due() */
+static uint16_t _g_sensor_drvdata[SENSOR_MAX];    /* Owned by the device's driver */
+static int16_t _g_sensor_reported[SENSOR_MAX];    /* Last value sent, in report units */
+static uint8_t _g_sensor_count;
+static uint8_t _g_sensor_dropped;
+static uint16_t _g_sensor_sweeps;     /* Completed, saturating */
+static onewire_search_t _g_sweep;
+
+static uint8_t _g_family_codes[SENSOR_NUM_FAMILIES] = { DS18B20_FAMILY_CODE, DS28E17_FAMILY_CODE };
+
+void sensors_init(void)
+{
+    _g_sensor_count = 0;
+    _g_sensor_dropped = 0;
+    _g_sensor_sweeps = 0;
+    onewire_search_begin(&_g_sweep);
+}
+
+/* The whole bus in one go */
+bool sensors_enumerate(uint8_t *counts)
+{
+    if (!onewire_search_devices(sensors_add, _g_family_codes, counts, SENSOR_NUM_FAMILIES))
+        return false;
+
+    if (_g_sensor_sweeps < 0xFFFF)
+        _g_sensor_sweeps++;
+
+    return true;
+}
+
+/*
+ * The bus one search pass at a time, so that sampling carries on in
+ * between. A device not in the table is added, and one which had left
+ * is marked present again. Either is returned in joined, for the caller
+ * to bring up. Devices the sweep didn't see are marked absent at the end.
+ */
+uint8_t sensors_sweep_step(uint8_t *joined)
+{
+    uint8_t step;
+    uint8_t idx;
+    uint8_t i;
+    int8_t family;
+
+    *joined = SENSOR_NONE;
+
+    if (_g_sweep.diff == OW_SEARCH_FIRST || _g_sweep.diff == OW_LAST_DEVICE)
+    {
+        for (i = 0; i < _g_sensor_count; i++)
+            _g_sensor_health[i].seen = 0;
+    }
+
+    step = onewire_search_step(&_g_sweep);
+
+    if (step == OW_STEP_ABORT || step == OW_STEP_COMMS)
+        return SENSOR_SWEEP_FAILED;
+
+    if (step != OW_STEP_EMPTY)
+    {
+        family = onewire_match_family(_g_sweep.id[0], _g_family_codes, SENSOR_NUM_FAMILIES);
+
+        if (family >= 0 && !crc8(_g_sweep.id, OW_ROMCODE_SIZE))
+        {
+            idx = sensors_find(_g_sweep.id);
+
+            if (idx == SENSOR_NONE)
+            {
+                if (sensors_add(_g_sweep.id, (uint8_t)family))
+                    *joined = idx = _g_sensor_count - 1;
+            }
+            else if (!_g_sensor_info[idx].present)
+            {
+                _g_sensor_info[idx].present = 1;
+                _g_sensor_health[idx].report_age = SENSOR_REPORT_NONE;
+                *joined = idx;
+            }
+
+            if (idx != SENSOR_NONE)
+                _g_sensor_health[idx].seen = 1;
+        }
+
+        if (step == OW_STEP_FOUND)
+            return SENSOR_SWEEP_BUSY;
+    }
+
+    for (i = 0; i < _g_sensor_count; i++)
+    {
+        if (_g_sensor_info[i].present && !_g_sensor_health[i].seen)
+        {
+            printf("Sensor %u left the bus\r\n", i);
+            _g_sensor_info[i].present = 0;
+            _g_sensor_info[i].pending = 0;
+        }
+    }
+
+    if (_g_sensor_sweeps < 0xFFFF)
+        _g_sensor_sweeps++;
+
+    return SENSOR_SWEEP_DONE;
+}
+
+/* Complete sweeps so far, by either method */
+uint16_t sensors_sweeps(void)
+{
+    return _g_sensor_sweeps;
+}
+
+uint8_t sensors_find(const uint8_t *id)
+{
+    uint8_t i;
+    uint8_t j;
+
+    for (i = 0; i < _g_sensor_count; i++)
+    {
+        if (_g_family_codes[_g_sensor_info[i].family] != id[0])
+            continue;
+
+        for (j = 0; j < SENSOR_SERIAL_SIZE; j++)
+        {
+            if (_g_sensor_serial[i][j] != id[j + 1])
+                break;
+        }
+
+        if (j == SENSOR_SERIAL_SIZE)
+            return i;
+    }
+
+    return SENSOR_NONE;
+}
+
+bool sensors_add(const uint8_t *id, uint8_t family)
+{
+    uint8_t i;
+    sensor_info_t *info;
+
+    if (_g_sensor_count >= SENSOR_MAX)
+    {
+        if (_g_sensor_dropped < 0xFF)
+            _g_sensor_dropped++;
+        return false;
+    }
+
+    for (i = 0; i < SENSOR_SERIAL_SIZE; i++)
+        _g_sensor_serial[_g_sensor_count][i] = id[i + 1];
+
+    info = &_g_sensor_info[_g_sensor_count];
+    info->family = family;
+    info->type = DEV_UNKNOWN;
+    info->present = 1;
+    info->pending = 0;
+    info->parasite = 0;
+
+    for (i = 0; i < SENSOR_NUM_ERRORS; i++)
+        _g_sensor_errors[_g_sensor_count][i] = 0;
+
+    _g_sensor_health[_g_sensor_count].fails = 0;
+    _g_sensor_health[_g_sensor_count].quarantined = 0;
+    _g_sensor_health[_g_sensor_count].seen = 0;
+    _g_sensor_health[_g_sensor_count].report_age = SENSOR_REPORT_NONE;
+    _g_sensor_skip[_g_sensor_count] = 0;
+    _g_sensor_drvdata[_g_sensor_count] = 0;
+    _g_sensor_reported[_g_sensor_count] = 0;
+
+    _g_sensor_count++;
+    return true;
+}
+
+uint8_t sensors_count(void)
+{
+    return _g_sensor_count;
+}
+
+/* Devices found on the bus which didn't fit in the table */
+uint8_t sensors_dropped(void)
+{
+    return _g_sensor_dropped;
+}
+
+/* Rebuild the full 8 byte ROM code, CRC included */
+void sensors_get_id(uint8_t idx, uint8_t *id)
+{
+    uint8_t i;
+
+    id[0] = _g_family_codes[_g_sensor_info[idx].family];
+
+    for (i = 0; i < SENSOR_SERIAL_SIZE; i++)
+        id[i + 1] = _g_sensor_serial[idx][i];
+
+    id[OW_ROMCODE_SIZE - 1] = crc8(id, OW_ROMCODE_SIZE - 1);
+}
+
+uint8_t sensors_family(uint8_t idx)
+{
+    return _g_sensor_info[idx].family;
+}
+
+uint8_t sensors_family_code(uint8_t idx)
+{
+    return _g_family_codes[_g_sensor_info[idx].family];
+}
+
+uint8_t sensors_type(uint8_t idx)
+{
+    return _g_sensor_info[idx].type;
+}
+
+void sensors_set_type(uint8_t idx, uint8_t type)
+{
+    _g_sensor_info[idx].type = type;
+}
+
+bool sensors_present(uint8_t idx)
+{
+    return _g_sensor_info[idx].present;
+}
+
+bool sensors_pending(uint8_t idx)
+{
+    return _g_sensor_info[idx].pending;
+}
+
+void sensors_set_pending(uint8_t idx, bool pending)
+{
+    _g_sensor_info[idx].pending = pending;
+}
+
+uint16_t sensors_drvdata(uint8_t idx)
+{
+    return _g_sensor_drvdata[idx];
+}
+
+void sensors_set_drvdata(uint8_t idx, uint16_t data)
+{
+    _g_sensor_drvdata[idx] = data;
+}
+
+int16_t sensors_reported(uint8_t idx, uint8_t *age)
+{
+    *age = _g_sensor_health[idx].report_age;
+    return _g_sensor_reported[idx];
+}
+
+void sensors_set_reported(uint8_t idx, int16_t value, uint8_t age)
+{
+    _g_sensor_reported[idx] = value;
+    _g_sensor_health[idx].report_age = age;
+}
+
+/* One report tick has passed for every device */
+void sensors_age_reports(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < _g_sensor_count; i++)
+    {
+        if (_g_sensor_health[i].report_age < SENSOR_REPORT_AGE_MAX)
+            _g_sensor_health[i].report_age++;
+    }
+}
+
+bool sensors_parasite(uint8_t idx)
+{
+    return _g_sensor_info[idx].parasite;
+}
+
+void sensors_set_parasite(uint8_t idx, bool parasite)
+{
+    _g_sensor_info[idx].parasite = parasite;
+}
+
+/*
+ * Called once per cycle. False while the device is backing off, or
+ * between reads at its polling interval. A failing device's skip count
+ * takes the whole byte. A healthy one's is the low bits, with its
+ * interval above, so the interval starts from the shortest after a
+ * failure.
+ */
+bool sensors_due(uint8_t idx)
+{
+    uint8_t mask = _g_sensor_health[idx].fails ? 0xFF : SENSOR_SKIP_COUNT;
+
+    if (_g_sensor_skip[idx] & mask)
+    {
+        _g_sensor_skip[idx]--;
+        return false;
+    }
+
+    return true;
+}
+
+uint8_t sensors_interval(uint8_t idx)
+{
+    if (_g_sensor_health[idx].fails)
+        return 0;
+
+    return _g_sensor_skip[idx] >> SENSOR_SKIP_INTERVAL_SHIFT;
+}
+
+/* After a good read. The device sits out the rest of its interval */
+void sensors_set_interval(uint8_t idx, uint8_t interval)
+{
+    if (_g_sensor_health[idx].fails)
+        return;
+
+    if (interval > SENSOR_INTERVAL_MAX)
+        interval = SENSOR_INTERVAL_MAX;
+
+    _g_sensor_skip[idx] = (interval << SENSOR_SKIP_INTERVAL_SHIFT) | ((1 << interval) - 1);
+}
+
+/*
+ * Account for the outcome of an operation on a device. Failures are
+ * charged to the cause recorded by the onewire layer and push the
+ * next attempt out by 0, 1, 3, 7 ... cycles, until the device is
+ * quarantined and only tried every SENSOR_QUARANTINE_SKIP cycles.
+ */
+void sensors_record(uint8_t idx, bool ok)
+{
+    sensor_health_t *health = &_g_sensor_health[idx];
+    uint8_t err;
+
+    if (ok)
+    {
+        health->fails = 0;
+        health->quarantined = 0;
+        return;
+    }
+
+    err = onewire_last_error();
+
+    /* Comms failure without a more specific cause */
+    if (err == OW_ERR_NONE)
+        err = OW_ERR_TIMEOUT;
+
+    if (_g_sensor_errors[idx][err - 1] < 0xFF)
+        _g_sensor_errors[idx][err - 1]++;
+
+    if (health->fails < SENSOR_FAILS_MAX)
+        health->fails++;
+
+    if (health->fails == SENSOR_FAILS_MAX)
+    {
+        health->quarantined = 1;
+        _g_sensor_skip[idx] = SENSOR_QUARANTINE_SKIP;
+    }
+    else
+    {
+        _g_sensor_skip[idx] = (1 << (health->fails - 1)) - 1;
+    }
+}
+
+void sensors_dump_stats(void)
+{
+    uint8_t i;
+    uint8_t j;
+    uint8_t id[OW_ROMCODE_SIZE];
+
+    printf("Idx ROM code         Pres CRC  Brdg Tout State\r\n");
+
+    for (i = 0; i < _g_sensor_count; i++)
+    {
+        sensors_get_id(i, id);
+
+        printf("%3u ", i);
+
+        for (j = 0; j < OW_ROMCODE_SIZE; j++)
+            printf("%02X", id[j]);
+
+        for (j = 0; j < SENSOR_NUM_ERRORS; j++)
+            printf(" %4u", _g_sensor_errors[i][j]);
+
+        if (_g_sensor_health[i].quarantined)
+            printf(" quarantined\r\n");
+        else if (_g_sensor_health[i].fails)
+            printf(" backoff %u\r\n", _g_sensor_skip[i]);
+        else
+            printf(" ok\r\n");
+    }
+
+    printf("\r\n");
+}
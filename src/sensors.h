@@ -0,0 +1,129 @@
+/*
+ *   File:   sensors.h
+ *   Author: Matt
+ *
+ *   Created on 19 October 2026, 11:40
+ *
+ *   This is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *   This software is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *   You should have received a copy of the GNU General Public License
+ *   along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SENSORS_H__
+#define __SENSORS_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/io.h>
+
+#include "report.h"
+
+#define DEV_UNKNOWN             0
+#define DEV_DS18B20             1
+#define DEV_VEML7700            2
+#define DEV_MPC9808             3
+#define DEV_NUM_TYPES           4
+
+/* Index into the family table. Two bits are stored per device */
+#define SENSOR_FAMILY_DS18B20   0
+#define SENSOR_FAMILY_DS28E17   1
+#define SENSOR_NUM_FAMILIES     2
+
+/* ROM code minus the family code (packed into the info byte) and the CRC (recomputed) */
+#define SENSOR_SERIAL_SIZE      6
+
+/* No such device */
+#define SENSOR_NONE             0xFF
+
+/* Outcome of sensors_sweep_step() */
+#define SENSOR_SWEEP_BUSY       0   /* One more device seen, the sweep continues */
+#define SENSOR_SWEEP_DONE       1   /* Sweep complete, departures applied */
+#define SENSOR_SWEEP_FAILED     2   /* The bus changed or failed mid sweep, it starts again */
+
+/* Error counters kept per device, one per OW_ERR_xxx cause */
+#define SENSOR_NUM_ERRORS       4
+
+/* Consecutive failures before a device is quarantined, and how many cycles it then sits out */
+#define SENSOR_FAILS_MAX        7
+#define SENSOR_QUARANTINE_SKIP  255
+
+/* Healthy devices are read every 1 << n cycles, n up to this */
+#define SENSOR_INTERVAL_MAX     5
+
+/* Report ticks since a device's value was last sent, as kept for the deadbands */
+#define SENSOR_REPORT_AGE_MAX   6
+#define SENSOR_REPORT_NONE      7   /* Nothing sent since it was found, rejoined or failed */
+
+/* Must match the arrays in sensors.c */
+#define SENSOR_BYTES_PER_DEVICE (SENSOR_SERIAL_SIZE + 1 + SENSOR_NUM_ERRORS + 6)
+
+/*
+ * Whatever isn't needed for the stack, console buffers, reports and stdio
+ * goes to the registry. The console's buffers shrank to make room for the
+ * reports. The reserve is a guess: the link fails if it leaves the stack
+ * less than STACK_MIN in the Makefile, and 's' shows how much of the
+ * stack has never been used.
+ */
+#define SENSOR_RAM_RESERVED     (768 + REPORT_RAM_BYTES)
+#define SENSOR_RAM_BUDGET       ((RAMEND - RAMSTART + 1) - SENSOR_RAM_RESERVED)
+
+#if (SENSOR_RAM_BUDGET / SENSOR_BYTES_PER_DEVICE) > 255
+#define SENSOR_MAX              255
+#else
+#define SENSOR_MAX              (SENSOR_RAM_BUDGET / SENSOR_BYTES_PER_DEVICE)
+#endif
+
+typedef struct
+{
+    uint8_t family : 2;   /* SENSOR_FAMILY_xxx */
+    uint8_t type : 3;     /* DEV_xxx */
+    uint8_t present : 1;  /* Answered the last search */
+    uint8_t pending : 1;  /* Awaiting a read this cycle */
+    uint8_t parasite : 1; /* DS18B20 without VDD, converts under the strong pull-up */
+} sensor_info_t;
+
+typedef struct
+{
+    uint8_t fails : 3;        /* Consecutive failures, saturating. Sets the backoff */
+    uint8_t quarantined : 1;  /* Hit SENSOR_FAILS_MAX. Only retried occasionally */
+    uint8_t seen : 1;         /* Found by the sweep in progress */
+    uint8_t report_age : 3;   /* Report ticks since the last value sent, or SENSOR_REPORT_NONE */
+} sensor_health_t;
+
+void sensors_init(void);
+bool sensors_enumerate(uint8_t *counts);
+bool sensors_add(const uint8_t *id, uint8_t family);
+uint8_t sensors_sweep_step(uint8_t *joined);
+uint16_t sensors_sweeps(void);
+uint8_t sensors_find(const uint8_t *id);
+bool sensors_present(uint8_t idx);
+uint8_t sensors_count(void);
+uint8_t sensors_dropped(void);
+void sensors_get_id(uint8_t idx, uint8_t *id);
+uint8_t sensors_family(uint8_t idx);
+uint8_t sensors_family_code(uint8_t idx);
+uint8_t sensors_type(uint8_t idx);
+void sensors_set_type(uint8_t idx, uint8_t type);
+bool sensors_pending(uint8_t idx);
+void sensors_set_pending(uint8_t idx, bool pending);
+uint16_t sensors_drvdata(uint8_t idx);
+void sensors_set_drvdata(uint8_t idx, uint16_t data);
+int16_t sensors_reported(uint8_t idx, uint8_t *age);
+void sensors_set_reported(uint8_t idx, int16_t value, uint8_t age);
+void sensors_age_reports(void);
+bool sensors_parasite(uint8_t idx);
+void sensors_set_parasite(uint8_t idx, bool parasite);
+bool sensors_due(uint8_t idx);
+uint8_t sensors_interval(uint8_t idx);
+void sensors_set_interval(uint8_t idx, uint8_t interval);
+void sensors_record(uint8_t idx, bool ok);
+void sensors_dump_stats(void);
+
+#endif /* __SENSORS_H__ */
@@ -0,0 +1,101 @@
+/*
+ *   File:   timer.c
+ *   Author: Matt
+ *
+ *   Created on 19 October 2026, 09:12
+ *
+ *   This is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *   This software is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *   You should have received a copy of the GNU General Public License
+ *   along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "project.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "timer.h"
+
+/*
+ * Timer0 in CTC mode, clk/64. At 16MHz that's 4us per count and a
+ * compare match every 250 counts, i.e. one tick per millisecond.
+ * Timer0 is used because it's the only 8-bit timer present on both the
+ * ATmega328P and the ATmega32U4.
+ */
+#define TIMER_PRESCALER          64
+#define TIMER_COUNTS_PER_TICK    ((F_CPU / TIMER_PRESCALER) / TIMEOUT_TICK_PER_SECOND)
+#define TIMER_US_PER_COUNT       (1000000UL / (F_CPU / TIMER_PRESCALER))
+
+#if TIMER_COUNTS_PER_TICK > 256
+#error Timer0 can not produce the requested tick rate with this prescaler
+#endif
+
+static volatile uint32_t _g_timer_ticks;
+
+ISR(TIMER0_COMPA_vect)
+{
+    _g_timer_ticks++;
+}
+
+void timer_init(void)
+{
+    _g_timer_ticks = 0;
+
+    TCCR0A = _BV(WGM01);                /* CTC, TOP = OCR0A */
+    TCCR0B = _BV(CS01) | _BV(CS00);     /* clk/64 */
+    OCR0A = TIMER_COUNTS_PER_TICK - 1;
+    TCNT0 = 0;
+    TIMSK0 = _BV(OCIE0A);
+}
+
+uint32_t timer_millis(void)
+{
+    uint32_t ticks;
+    uint8_t intsave;
+
+    intsave = (SREG & _BV(SREG_I)) == _BV(SREG_I);
+    g_irq_disable();
+
+    ticks = _g_timer_ticks;
+
+    if (intsave)
+        g_irq_enable();
+
+    return ticks * TIMEOUT_MS_PER_TICK;
+}
+
+/* Microsecond timestamp for profiling. Resolution is one timer count (4us) */
+uint32_t timer_micros(void)
+{
+    uint32_t ticks;
+    uint8_t count;
+    uint8_t intsave;
+
+    intsave = (SREG & _BV(SREG_I)) == _BV(SREG_I);
+    g_irq_disable();
+
+    ticks = _g_timer_ticks;
+    count = TCNT0;
+
+    /*
+     * Compare match happened while interrupts were off. The ISR hasn't
+     * run yet, so account for the tick here. If the count reads as TOP
+     * the match occurred after we sampled it, and the tick isn't ours.
+     */
+    if ((TIFR0 & _BV(OCF0A)) && count < (TIMER_COUNTS_PER_TICK - 1))
+        ticks++;
+
+    if (intsave)
+        g_irq_enable();
+
+    return (ticks * TIMEOUT_MS_PER_TICK * 1000UL) + ((uint16_t)count * TIMER_US_PER_COUNT);
+}
@@ -0,0 +1,33 @@
+/*
+ *   File:   timer.h
+ *   Author: Matt
+ *
+ *   Created on 19 October 2026, 09:12
+ *
+ *   This is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *   This software is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *   You should have received a copy of the GNU General Public License
+ *   along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TIMER_H__
+#define __TIMER_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+void timer_init(void);
+uint32_t timer_millis(void);
+uint32_t timer_micros(void);
+
+/* Wrap-safe timeout checks against a timestamp taken earlier */
+#define timeout_expired_ms(since, ms) ((uint32_t)(timer_millis() - (since)) >= (uint32_t)(ms))
+#define timeout_expired_us(since, us) ((uint32_t)(timer_micros() - (since)) >= (uint32_t)(us))
+
+#endif /* __TIMER_H__ */
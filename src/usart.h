@@ -32,6 +32,7 @@
 void usart1_open(uint8_t flags, uint16_t brg);
 bool usart1_busy(void);
 void usart1_put(char c);
+void usart1_kick(void);
 bool usart1_data_ready(void);
 char usart1_get(void);
 void usart1_clear_oerr(void);
@@ -24,35 +24,28 @@
 #include <avr/interrupt.h>
 
 #include "usart_buffered.h"
+#include "ring.h"
+#include "report.h"
 #include "iopins.h"
 
-#define UART_TX_BUFFER_SIZE 64
-#define UART_RX_BUFFER_SIZE 256
+#define UART_TX_BUFFER_SIZE 32     /* Status lines. Reports are formatted as they go */
+#define UART_RX_BUFFER_SIZE 32     /* Single key commands */
 
 #ifdef _USART1_
 
-/* size of RX/TX buffers */
-#define UART_RX_BUFFER_MASK (UART_RX_BUFFER_SIZE - 1)
-#define UART_TX_BUFFER_MASK (UART_TX_BUFFER_SIZE - 1)
-
-#if (UART_RX_BUFFER_SIZE & UART_RX_BUFFER_MASK)
-#error RX buffer size is not a power of 2
-#endif
-#if (UART_TX_BUFFER_SIZE & UART_TX_BUFFER_MASK)
-#error TX buffer size is not a power of 2
-#endif
-
-static volatile uint8_t _g_usart_txbuf[UART_TX_BUFFER_SIZE];
-static volatile uint8_t _g_usart_rxbuf[UART_RX_BUFFER_SIZE];
-static volatile uint8_t _g_usart_txhead;
-static volatile uint8_t _g_usart_txtail;
-static volatile uint8_t _g_usart_rxhead;
-static volatile uint8_t _g_usart_rxtail;
+/* Main pushes and the UDRE interrupt pops, and the other way round for receive */
+RING_DECLARE(usart_ring_tx, uint8_t, UART_TX_BUFFER_SIZE);
+RING_DECLARE(usart_ring_rx, uint8_t, UART_RX_BUFFER_SIZE);
+RING_DEFINE(usart_ring_tx, uint8_t, UART_TX_BUFFER_SIZE)
+RING_DEFINE(usart_ring_rx, uint8_t, UART_RX_BUFFER_SIZE)
+
+static usart_ring_tx_t _g_usart_tx;
+static usart_ring_rx_t _g_usart_rx;
 static volatile uint8_t _g_usart_last_rx_error;
+static bool _g_usart_tx_midline;   /* A line from the buffer has been started */
 
 ISR(USARTA_RX_vect)
 {
-    uint8_t tmphead;
     uint8_t data;
     uint8_t usr;
     uint8_t lastRxError;
@@ -61,30 +54,33 @@ ISR(USARTA_RX_vect)
     data = UDRA;
     
     lastRxError = (usr & (_BV(FEA) | _BV(DORA)));
-    tmphead = (_g_usart_rxhead + 1) & UART_RX_BUFFER_MASK;
-    
-    if (tmphead == _g_usart_rxtail)
-    {
+
+    if (!usart_ring_rx_push(&_g_usart_rx, &data))
         lastRxError = UART_BUFFER_OVERFLOW >> 8;
-    }
-    else
-    {
-        _g_usart_rxhead = tmphead;
-        _g_usart_rxbuf[tmphead] = data;
-    }
 
     _g_usart_last_rx_error = lastRxError;   
 }
 
+/*
+ * Reports are sent when there's nothing else, a whole line at a time,
+ * so they never split a line of printf output or vice versa.
+ */
 ISR(USARTA_UDRE_vect)
 {
-    uint8_t tmptail;
-    
-    if (_g_usart_txhead != _g_usart_txtail)
+    uint8_t data;
+    int16_t c = -1;
+
+    if (!_g_usart_tx_midline)
+        c = report_tx_next(usart_ring_tx_count(&_g_usart_tx) == 0);
+
+    if (c >= 0)
     {
-        tmptail = (_g_usart_txtail + 1) & UART_TX_BUFFER_MASK;
-        _g_usart_txtail = tmptail;
-        UDRA = _g_usart_txbuf[tmptail];
+        UDRA = (uint8_t)c;
+    }
+    else if (usart_ring_tx_pop(&_g_usart_tx, &data))
+    {
+        UDRA = data;
+        _g_usart_tx_midline = data != '\n';
     }
     else
     {
@@ -94,10 +90,8 @@ ISR(USARTA_UDRE_vect)
 
 void usart1_open(uint8_t flags, uint16_t brg)
 {
-    _g_usart_txhead = 0;
-    _g_usart_txtail = 0;
-    _g_usart_rxhead = 0;
-    _g_usart_rxtail = 0;
+    usart_ring_tx_init(&_g_usart_tx);
+    usart_ring_rx_init(&_g_usart_rx);
     
     if (flags & USART_SYNC)
         UCSRAC |= _BV(UMSELA0);
@@ -143,39 +137,37 @@ void usart1_open(uint8_t flags, uint16_t brg)
 
 bool usart1_data_ready(void)
 {
-    if (_g_usart_rxhead == _g_usart_rxtail)
-        return false;
-    return true;
+    return usart_ring_rx_count(&_g_usart_rx) != 0;
 }
 
 char usart1_get(void)
 {
-    uint8_t tmptail;
+    uint8_t data;
 
-    if (_g_usart_rxhead == _g_usart_rxtail)
+    if (!usart_ring_rx_pop(&_g_usart_rx, &data))
         return 0x00;
-    
-    tmptail = (_g_usart_rxtail + 1) & UART_RX_BUFFER_MASK;
-    _g_usart_rxtail = tmptail;
-    
-    return _g_usart_rxbuf[tmptail];
+
+    return data;
 }
 
 void usart1_put(char c)
 {
-    uint8_t tmphead = (_g_usart_txhead + 1) & UART_TX_BUFFER_MASK;
-    
-    while (tmphead == _g_usart_txtail);
-    
-    _g_usart_txbuf[tmphead] = c;
-    _g_usart_txhead = tmphead;
+    uint8_t data = c;
+
+    while (!usart_ring_tx_push(&_g_usart_tx, &data));
+
+    UCSRAB |= _BV(UDRIEA);
+}
 
+/* There may be something to send besides the buffer */
+void usart1_kick(void)
+{
     UCSRAB |= _BV(UDRIEA);
 }
 
 bool usart1_busy(void)
 {
-    return (_g_usart_txhead != _g_usart_txtail || (UCSRAA & _BV(UDREA)) == 0);
+    return (usart_ring_tx_count(&_g_usart_tx) != 0 || (UCSRAA & _BV(UDREA)) == 0);
 }
 
 void usart1_clear_oerr(void)
@@ -23,13 +23,41 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
+#include <avr/io.h>
 
 #include "util.h"
 #include "usart.h"
 
+/* Only waits when the buffer is full, so the bus isn't held up by the console */
 int print_char(char byte, FILE *stream)
 {
-    while (console_busy());
     console_put(byte);
     return 0;
-}
\ No newline at end of file
+}
+
+/*
+ * Fills everything between the end of .bss and the stack with a known
+ * byte before main() runs, so stack_unused() can tell how deep the stack
+ * has ever been. Runs once the stack pointer is set and before .data is
+ * copied, and uses no stack itself.
+ */
+void stack_paint(void) __attribute__((naked, used, section(".init3")));
+
+void stack_paint(void)
+{
+    uint8_t *p = &__heap_start;
+
+    while (p < (uint8_t *)SP)
+        *p++ = STACK_PAINT;
+}
+
+/* Bytes above the end of .bss the stack has never reached */
+uint16_t stack_unused(void)
+{
+    const uint8_t *p = &__heap_start;
+
+    while (p <= (const uint8_t *)RAMEND && *p == STACK_PAINT)
+        p++;
+
+    return (uint16_t)(p - &__heap_start);
+}
@@ -23,6 +23,11 @@ void reset(void);
 void eeprom_read_data(uint8_t addr, uint8_t *bytes, uint8_t len);
 void eeprom_write_data(uint8_t addr, uint8_t *bytes, uint8_t len);
 int print_char(char byte, FILE *stream);
+uint16_t stack_unused(void);
+
+#define STACK_PAINT 0xC5
+
+extern uint8_t __heap_start;    /* End of .bss, set by the linker */
 
 #undef printf
 #define printf(fmt, ...) printf_P(PSTR(fmt) __VA_OPT__(,) __VA_ARGS__)
@@ -22,6 +22,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <avr/pgmspace.h>
 
 #include "veml7700.h"
 #include "ds28e17.h"
@@ -29,10 +30,25 @@
 #define VEML7700_I2C_ADDR       0x10
 
 #define VEML7700_ALS_CONF_0     0x00
+#define VEML7700_ALS_WH         0x01
+#define VEML7700_ALS_WL         0x02
+#define VEML7700_POWER_SAVING   0x03
 #define VEML7700_ALS            0x04
+#define VEML7700_ALS_INT        0x06
 
-#define VEML7700_BASE_FACTOR    36
-#define VEML7700_SCALE_FACTOR   1000
+/*
+ * Lux per count at x2 gain and 800ms is 0.0036, so 0.036 decilux. Every
+ * step doubles that, so the shift drops by one. 0.036 is applied as
+ * 2359 / 2^16 (0.0125% low) so that scaling is a multiply and a shift.
+ */
+#define VEML7700_SCALE_MUL      2359
+#define VEML7700_SCALE_SHIFT    16
+
+/* Counts worth keeping. Below is mostly noise, above is non-linear */
+#define VEML7700_RAW_LOW        100
+#define VEML7700_RAW_HIGH       10000
+#define VEML7700_RAW_SATURATED  0xFFFF
+#define VEML7700_SATURATED_JUMP 3
 
 // Configuration register values
 #define VEML7700_G_X1           (0 << 11)
@@ -47,61 +63,162 @@
 #define VEML7700_IT_50         (8 << 6)
 #define VEML7700_IT_25         (12 << 6)
 
-// Change these values to for different configurations
-#define VEML7700_GAIN           VEML7700_G_X1
-#define VEML7700_IT             VEML7700_IT_100
-
-#if   VEML7700_GAIN == VEML7700_G_X2
-#define VEML7700_GAIN_FACTOR    1
-#elif VEML7700_GAIN == VEML7700_G_X1
-#define VEML7700_GAIN_FACTOR    2
-#elif VEML7700_GAIN == VEML7700_G_D4
-#define VEML7700_GAIN_FACTOR    8
-#elif VEML7700_GAIN == VEML7700_G_D8
-#define VEML7700_GAIN_FACTOR    16
-#endif
-
-#if   VEML7700_IT == VEML7700_IT_800
-#define VEML7700_IT_FACTOR      1
-#elif VEML7700_IT == VEML7700_IT_400
-#define VEML7700_IT_FACTOR      2
-#elif VEML7700_IT == VEML7700_IT_200
-#define VEML7700_IT_FACTOR      4
-#elif VEML7700_IT == VEML7700_IT_100
-#define VEML7700_IT_FACTOR      8
-#elif VEML7700_IT == VEML7700_IT_50
-#define VEML7700_IT_FACTOR      16
-#elif VEML7700_IT == VEML7700_IT_25
-#define VEML7700_IT_FACTOR      32
-#endif
-
-#define VEML7700_FACTOR    (VEML7700_BASE_FACTOR * VEML7700_GAIN_FACTOR * VEML7700_IT_FACTOR)
-
-static uint32_t veml7700_scale_lux(uint16_t reg_value);
-
-bool veml7700_init(const uint8_t *host_id)
+#define VEML7700_ALS_INT_EN     (1 << 1)
+
+#define VEML7700_INT_TH_LOW     (1 << 15)
+#define VEML7700_INT_TH_HIGH    (1 << 14)
+
+/*
+ * Power saving mode 4: a result every integration time plus 4s. Off
+ * unless asked for, as it delays every change by up to that long.
+ */
+#define VEML7700_PSM_EN         (1 << 0)
+#define VEML7700_PSM_4          (3 << 1)
+#define VEML7700_PSM_WAIT_MS    4000
+
+/* Thresholds are the last result, plus or minus 1/8th and a count */
+#define VEML7700_WINDOW_SHIFT   3
+
+/* Each step twice the lux per count of the one before */
+static const uint16_t _g_step_conf[VEML7700_STEPS] PROGMEM =
+{
+    VEML7700_G_X2 | VEML7700_IT_800,
+    VEML7700_G_X2 | VEML7700_IT_400,
+    VEML7700_G_X2 | VEML7700_IT_200,
+    VEML7700_G_X2 | VEML7700_IT_100,
+    VEML7700_G_X1 | VEML7700_IT_100,
+    VEML7700_G_X1 | VEML7700_IT_50,
+    VEML7700_G_D4 | VEML7700_IT_100,
+    VEML7700_G_D8 | VEML7700_IT_100,
+    VEML7700_G_D8 | VEML7700_IT_50,
+    VEML7700_G_D8 | VEML7700_IT_25,
+};
+
+/* Integration time of each step, in ms */
+static const uint16_t _g_step_ms[VEML7700_STEPS] PROGMEM = { 800, 400, 200, 100, 100, 50, 100, 100, 50, 25 };
+
+static uint32_t veml7700_scale_lux(uint16_t reg_value, uint8_t step);
+static uint8_t veml7700_next_step(uint16_t reg_value, uint8_t step);
+static bool veml7700_set_window(const uint8_t *host_id, uint16_t reg_value);
+static bool veml7700_set_step(const uint8_t *host_id, uint8_t step);
+static bool veml7700_write_reg(const uint8_t *host_id, uint8_t reg, uint16_t value);
+
+bool veml7700_init(const uint8_t *host_id, uint8_t step, bool power_saving)
 {
-    uint16_t confreg_value = (VEML7700_GAIN | VEML7700_IT);
+    if (!veml7700_write_reg(host_id, VEML7700_POWER_SAVING, power_saving ? VEML7700_PSM_4 | VEML7700_PSM_EN : 0))
+        return false;
+
+    return veml7700_set_step(host_id, step);
+}
+
+/*
+ * Time from a read until the next result is certainly a fresh one. Once
+ * restarted, by veml7700_init() or a change of step, the first result
+ * takes one integration time, without the power saving wait. The timing
+ * is only good to 10% or so.
+ */
+uint16_t veml7700_refresh_ms(uint8_t step, bool restarted, bool power_saving)
+{
+    uint16_t ms = pgm_read_word(&_g_step_ms[step]);
+
+    if (power_saving && !restarted)
+        ms += VEML7700_PSM_WAIT_MS;
+
+    return ms + (ms >> 3);
+}
+
+/*
+ * Whether the light has left the window set at the last read. Reading
+ * the status clears it.
+ */
+bool veml7700_crossed(const uint8_t *host_id, bool *crossed)
+{
+    uint16_t reg_value;
 
-    return ds28e17_i2c_write(host_id, VEML7700_I2C_ADDR, VEML7700_ALS_CONF_0, (uint8_t *)&confreg_value, sizeof(uint16_t));
+    if (!ds28e17_i2c_read(host_id, VEML7700_I2C_ADDR, VEML7700_ALS_INT, (uint8_t *)&reg_value, sizeof(uint16_t)))
+        return false;
+
+    *crossed = (reg_value & (VEML7700_INT_TH_LOW | VEML7700_INT_TH_HIGH)) != 0;
+    return true;
 }
 
-// Returns fixed point output i.e. 10 = 1.0 lux
-bool veml7700_read_decilux(const uint8_t *host_id, uint32_t *lux)
+/*
+ * Returns fixed point output i.e. 10 = 1.0 lux, at the step in use. If
+ * the counts were out of range, the next step is chosen from them and
+ * written to the device. Otherwise the threshold window is set around
+ * the result.
+ */
+bool veml7700_read_decilux(const uint8_t *host_id, uint8_t *step, uint32_t *lux)
 {
     uint16_t reg_value;
+    uint8_t next;
 
     if (!ds28e17_i2c_read(host_id, VEML7700_I2C_ADDR, VEML7700_ALS, (uint8_t *)&reg_value, sizeof(uint16_t)))
         return false;
 
-    *lux = veml7700_scale_lux(reg_value);
+    *lux = veml7700_scale_lux(reg_value, *step);
+
+    next = veml7700_next_step(reg_value, *step);
+
+    if (next == *step)
+        return veml7700_set_window(host_id, reg_value);
 
+    if (!veml7700_set_step(host_id, next))
+        return false;
+
+    *step = next;
     return true;
 }
 
-static uint32_t veml7700_scale_lux(uint16_t reg_value)
+static bool veml7700_set_window(const uint8_t *host_id, uint16_t reg_value)
 {
-    uint32_t final_value = ((uint32_t)reg_value * VEML7700_FACTOR);
-    final_value /= VEML7700_SCALE_FACTOR;
-    return final_value;
-}
\ No newline at end of file
+    uint16_t margin = (reg_value >> VEML7700_WINDOW_SHIFT) + 1;
+    uint16_t high = reg_value < VEML7700_RAW_SATURATED - margin ? reg_value + margin : VEML7700_RAW_SATURATED;
+    uint16_t low = reg_value > margin ? reg_value - margin : 0;
+
+    if (!veml7700_write_reg(host_id, VEML7700_ALS_WH, high))
+        return false;
+
+    return veml7700_write_reg(host_id, VEML7700_ALS_WL, low);
+}
+
+/* Restarts the part. The window from the previous step doesn't apply until set again */
+static bool veml7700_set_step(const uint8_t *host_id, uint8_t step)
+{
+    return veml7700_write_reg(host_id, VEML7700_ALS_CONF_0, pgm_read_word(&_g_step_conf[step]) | VEML7700_ALS_INT_EN);
+}
+
+static bool veml7700_write_reg(const uint8_t *host_id, uint8_t reg, uint16_t value)
+{
+    return ds28e17_i2c_write(host_id, VEML7700_I2C_ADDR, reg, (uint8_t *)&value, sizeof(uint16_t));
+}
+
+static uint32_t veml7700_scale_lux(uint16_t reg_value, uint8_t step)
+{
+    return ((uint32_t)reg_value * VEML7700_SCALE_MUL) >> (VEML7700_SCALE_SHIFT - step);
+}
+
+/* Each step up halves the counts for the same light, each step down doubles them */
+static uint8_t veml7700_next_step(uint16_t reg_value, uint8_t step)
+{
+    /* Saturated says nothing about how far over, so jump */
+    if (reg_value == VEML7700_RAW_SATURATED)
+    {
+        step += VEML7700_SATURATED_JUMP;
+        return step < VEML7700_STEPS ? step : VEML7700_STEPS - 1;
+    }
+
+    while (reg_value > VEML7700_RAW_HIGH && step < VEML7700_STEPS - 1)
+    {
+        reg_value >>= 1;
+        step++;
+    }
+
+    while (reg_value < VEML7700_RAW_LOW && step > 0)
+    {
+        reg_value <<= 1;
+        step--;
+    }
+
+    return step;
+}
@@ -19,7 +19,14 @@
 #ifndef __VEML7700_H__
 #define __VEML7700_H__
 
-bool veml7700_init(const uint8_t *host_id);
-bool veml7700_read_decilux(const uint8_t *host_id, uint32_t *lux);
+/* Auto-ranging steps, from most to least sensitive */
+#define VEML7700_STEPS          10
+#define VEML7700_STEP_DEFAULT   4       /* x1, 100ms */
+#define VEML7700_REFRESH_MAX_MS 5400    /* veml7700_refresh_ms() at its longest: 800ms, power saving */
+
+bool veml7700_init(const uint8_t *host_id, uint8_t step, bool power_saving);
+bool veml7700_read_decilux(const uint8_t *host_id, uint8_t *step, uint32_t *lux);
+bool veml7700_crossed(const uint8_t *host_id, bool *crossed);
+uint16_t veml7700_refresh_ms(uint8_t step, bool restarted, bool power_saving);
 
 #endif /* __VEML7700_H__ */
\ No newline at end of file